@@ -0,0 +1,173 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+#
+# Aggregate the airtime and energest counters logged by the nodes when built
+# with AIRTIME_ACCOUNTING (see senslab-app/net/airtime.h) into per-node and
+# per-site throughput reports
+#
+
+import sys
+import re
+
+import senslab
+
+# the rtimer rate on the wsn430
+RTIMER_SECOND = 32768.
+
+CHANNELS = ('sync', 'data')
+AIR_FIELDS = ('txp', 'txfail', 'txbytes', 'txtime', 'rxp', 'rxbytes', 'crc', 'disc')
+ENERGEST_FIELDS = ('cpu', 'lpm', 'tx', 'listen')
+
+
+class NodeAirtime():
+    def __init__(self, nodeid, nodelog):
+        self._nodeid = nodeid
+
+        # channel -> epoch -> dict of counters
+        self._air = dict((ch, {}) for ch in CHANNELS)
+        # epoch -> dict of energest times
+        self._energest = {}
+
+        for line in nodelog:
+            m = re.search(r'^@([0-9]+) air ([a-z]+) ([0-9 ]+)$', line)
+            if m is not None:
+                epoch = int(m.group(1))
+                channel = m.group(2)
+                values = [int(x) for x in m.group(3).split()]
+                if channel in CHANNELS and len(values) == len(AIR_FIELDS):
+                    self._air[channel][epoch] = dict(zip(AIR_FIELDS, values))
+                continue
+
+            m = re.search(r'^@([0-9]+) energest ([0-9 ]+)$', line)
+            if m is not None:
+                epoch = int(m.group(1))
+                values = [int(x) for x in m.group(2).split()]
+                if len(values) == len(ENERGEST_FIELDS):
+                    self._energest[epoch] = dict(zip(ENERGEST_FIELDS, values))
+                continue
+
+
+    def get_id(self):
+        return self._nodeid
+
+
+    def nr_epochs(self, channel):
+        return len(self._air[channel])
+
+
+    def per_epoch(self, channel, field):
+        """Return the mean of `field` per epoch on the given channel."""
+        epochs = self._air[channel]
+        if not len(epochs):
+            return 0.
+        return float(sum(c[field] for c in epochs.values()))/len(epochs)
+
+
+    def radio_duty_cycle(self):
+        """Return the fraction of time the radio was on (tx or listen)."""
+        on = sum(e['tx'] + e['listen'] for e in self._energest.values())
+        total = sum(e['cpu'] + e['lpm'] for e in self._energest.values())
+        if not total:
+            return None
+        return float(on)/total
+
+
+def _print_node_report(node):
+    print "node nr.%3d" % node.get_id()
+    for channel in CHANNELS:
+        if not node.nr_epochs(channel):
+            continue
+
+        txp = node.per_epoch(channel, 'txp')
+        txfail = node.per_epoch(channel, 'txfail')
+        fail_rate = 0.
+        if txp:
+            fail_rate = txfail/txp
+
+        print "  %s: %d epochs, per epoch tx %.1f pkts %.1f B %.2f ms (%.1f%% failed), rx %.1f pkts %.1f B, %.2f crc errors, %.2f discarded" % (
+            channel, node.nr_epochs(channel),
+            txp, node.per_epoch(channel, 'txbytes'), 1000.*node.per_epoch(channel, 'txtime')/RTIMER_SECOND, 100.*fail_rate,
+            node.per_epoch(channel, 'rxp'), node.per_epoch(channel, 'rxbytes'),
+            node.per_epoch(channel, 'crc'), node.per_epoch(channel, 'disc'))
+
+    duty = node.radio_duty_cycle()
+    if duty is not None:
+        print "  radio on %.2f%% of the time" % (100.*duty)
+
+
+def _print_site_report(site, nodes):
+    print "site %s, %d nodes" % (site, len(nodes))
+    for channel in CHANNELS:
+        active = [n for n in nodes if n.nr_epochs(channel)]
+        if not len(active):
+            continue
+
+        tx_bytes = sum(n.per_epoch(channel, 'txbytes') for n in active)
+        rx_bytes = sum(n.per_epoch(channel, 'rxbytes') for n in active)
+        tx_time = sum(n.per_epoch(channel, 'txtime') for n in active)/RTIMER_SECOND
+        print "  %s: per epoch the network sent %.1f B in %.2f s of airtime and received %.1f B (%.1f B/node)" % (
+            channel, tx_bytes, tx_time, rx_bytes, rx_bytes/len(active))
+
+    duties = [d for d in [n.radio_duty_cycle() for n in nodes] if d is not None]
+    if len(duties):
+        print "  radio on %.2f%% of the time (min %.2f%%, max %.2f%%)" % (100.*sum(duties)/len(duties), 100.*min(duties), 100.*max(duties))
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser(usage="usage: %prog [options] experiment.log [experiment.log ...]")
+    parser.add_option("-s", "--site", dest="site",
+                      help="set the senslab site the experiments were run on.", metavar="site")
+    parser.add_option("-n", "--nodes", action="store_true", dest="nodes", default=False,
+                      help="also print the report of each node.")
+
+    (options, args) = parser.parse_args()
+
+    if not len(args):
+        print "error: no experiment log given.\n"
+        parser.print_help()
+        sys.exit(0)
+
+    if not options.site:
+        print "error: no senslab site given."
+        sys.exit(0)
+
+    if not senslab.siteinfo.exists(options.site):
+        print "error: unknown senslab site \"%s\"." % options.site
+        sys.exit(0)
+
+    nodes = []
+    for log_path in args:
+        print "Loading %s ..." % log_path
+        nodelogs = senslab.Network._split_node_data(log_path, False)
+        for nodeid in sorted(nodelogs.keys()):
+            nodes.append(NodeAirtime(nodeid, nodelogs[nodeid]))
+
+    if options.nodes:
+        for node in nodes:
+            _print_node_report(node)
+        print
+
+    _print_site_report(options.site, nodes)
@@ -0,0 +1,112 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Calibrate the thresholds of the GLR change test by Monte Carlo simulation
+# (see change_detection/calibration.py) and cache them for change-detection.py
+#
+
+import sys
+import time
+import multiprocessing
+
+import change_detection.calibration as calibration
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser()
+    parser.add_option("-M", type="int", dest="M",
+                      help="the number of samples of the size estimator (UNIFORM_SIZE_ESTIMATOR_M).", metavar="M")
+    parser.add_option("-N", type="int", dest="N", default=25,
+                      help="the length of the test window (default: 25).", metavar="N")
+    parser.add_option("-b", "--barN", type="int", dest="barN", default=10,
+                      help="the minimum length of the pre-change window (default: 10).", metavar="barN")
+    parser.add_option("-s", "--sigma", type="float", dest="sigma", default=1.0,
+                      help="the relative size drop tested (default: 1.0).", metavar="sigma")
+    parser.add_option("-a", "--alpha0", dest="alpha0", default="0.001,0.002,0.01,0.05",
+                      help="the comma separated false alarm probabilities to calibrate for (default: 0.001,0.002,0.01,0.05).", metavar="alpha0")
+    parser.add_option("-r", "--runs", type="int", dest="runs", default=1000000,
+                      help="the number of simulated windows (default: 1000000).", metavar="runs")
+    parser.add_option("-j", "--jobs", type="int", dest="jobs", default=multiprocessing.cpu_count(),
+                      help="simulate with `jobs` worker processes (default: the number of cpus).", metavar="jobs")
+    parser.add_option("--seed", type="int", dest="seed", default=0,
+                      help="the seed of the random generators (default: 0).", metavar="seed")
+    parser.add_option("-f", "--force", action="store_true", dest="force", default=False,
+                      help="calibrate again the thresholds already cached.")
+
+    (options, args) = parser.parse_args()
+
+    if len(args):
+        print "error: cannot parse these arguments %s\n" % args
+        parser.print_help()
+        sys.exit(0)
+
+    if options.M is None or options.M <= 0:
+        print "error: no valid M given."
+        sys.exit(0)
+
+    if options.N <= 0 or options.barN < 1 or options.barN >= options.N:
+        print "error: choose N > barN >= 1."
+        sys.exit(0)
+
+    if options.sigma <= 0. or options.sigma > 1.:
+        print "error: choose sigma in (0, 1]."
+        sys.exit(0)
+
+    if options.jobs < 1:
+        print "error: the number of jobs must be positive."
+        sys.exit(0)
+
+    try:
+        alpha_0s = [float(a) for a in options.alpha0.split(',')]
+    except ValueError:
+        print "error: cannot parse alpha0 \"%s\"." % options.alpha0
+        sys.exit(0)
+
+    if min(alpha_0s) <= 0. or max(alpha_0s) >= 1.:
+        print "error: choose alpha0 in (0, 1)."
+        sys.exit(0)
+
+    if min(alpha_0s)*options.runs < 100:
+        print "warning: only %d runs below the threshold for alpha_0=%g, the estimate will be noisy" % (int(min(alpha_0s)*options.runs), min(alpha_0s))
+        if min(alpha_0s)*options.runs < 1:
+            sys.exit(0)
+
+    M, N, barN, sigma = options.M, options.N, options.barN, options.sigma
+    if not options.force:
+        alpha_0s = [a for a in alpha_0s if calibration.load(M, N, barN, sigma, a) is None]
+        if not len(alpha_0s):
+            print "The thresholds are already cached, use --force to calibrate them again."
+            sys.exit(0)
+
+    print "Calibrating M=%d, N=%d, barN=%d, sigma=%.3f, alpha0=%s over %d runs with %d jobs ..." % (M, N, barN, sigma, ','.join('%g' % a for a in alpha_0s), options.runs, options.jobs)
+    start = time.time()
+    thresholds = calibration.calibrate(M, N, barN, sigma, alpha_0s, options.runs, options.jobs, options.seed)
+    print "done in %.1f s" % (time.time() - start)
+
+    for alpha_0 in alpha_0s:
+        calibration.store(M, N, barN, sigma, alpha_0, thresholds[alpha_0], options.runs, options.seed)
+        print "alpha0=%g: %s" % (alpha_0, ', '.join('%.4f' % t for t in thresholds[alpha_0]))
@@ -29,6 +29,7 @@ import re
 import time
 import shutil
 import subprocess
+import multiprocessing
 
 #sys.path.append(os.path.abspath('/math'))
 #from fixpointops import *
@@ -38,6 +39,8 @@ import numpy
 import senslab
 
 import change_detection
+import change_detection.sweep
+import change_detection.online
 
 EXPERIMENT_LOG_FILENAME = 'experiment.log'
 
@@ -114,6 +117,18 @@ if __name__ == "__main__":
                       help="set one of the following sites strasbourg (default), lille or grenoble. This is only necessary when fetching data from the vm.", metavar="site")
     parser.add_option("-o", "--output-split-logs", action="store_true", dest="output_split_logs", default=False,
                       help="output split-logs one for each node.")
+    parser.add_option("-n", "--no-cache", action="store_false", dest="use_cache", default=True,
+                      help="parse the experiment log even if a valid parsed log cache exists.")
+    parser.add_option("-j", "--jobs", type="int", dest="jobs", default=multiprocessing.cpu_count(),
+                      help="load the nodes and render the frames with `jobs` worker processes (default: the number of cpus).", metavar="jobs")
+    parser.add_option("--save-frames", action="store_true", dest="save_frames", default=False,
+                      help="also save every frame of the video, with the node positions and links lists, to the frames folder.")
+    parser.add_option("--online", dest="online",
+                      help="run the change detection online on the lines read from `path` (`-` for stdin), following the file as it is appended to.", metavar="path")
+    parser.add_option("-w", "--sweep", dest="sweep",
+                      help="run the change detector for every parameter tuple in `grid` and print a summary, without rendering. `grid` is a list like \"N=20,25;barN=10;alpha0=0.001,0.01;sigma=1.0\", the parameters not listed keep their default.", metavar="grid")
+    parser.add_option("-c", "--change-epoch", type="int", dest="change_epoch",
+                      help="the epoch at which the network changed, used by --sweep to measure the detection delays.", metavar="epoch")
 
     (options, args) = parser.parse_args()
 
@@ -122,6 +137,10 @@ if __name__ == "__main__":
         parser.print_help()
         sys.exit(0)
 
+    if options.jobs < 1:
+        print "error: the number of jobs must be positive."
+        sys.exit(0)
+
     if not options.site:
         print "error: no senslab site given."
         sys.exit(0)
@@ -130,6 +149,15 @@ if __name__ == "__main__":
         print "error: unknown senslab site \"%s\"." % options.site
         sys.exit(0)
         
+    CHANGE_DETECTOR_N      = 25
+    CHANGE_DETECTOR_BARN   = 10
+    CHANGE_DETECTOR_ALPHA0 = 0.001
+    CHANGE_DETECTOR_SIGMA  = 1.0
+
+    if options.online:
+        change_detection.online.run(options.online, CHANGE_DETECTOR_N, CHANGE_DETECTOR_BARN, CHANGE_DETECTOR_ALPHA0, CHANGE_DETECTOR_SIGMA)
+        sys.exit(0)
+
     if not options.local and not options.fetch:
         options.local = 'last'
     elif options.local and options.fetch:
@@ -207,15 +235,29 @@ if __name__ == "__main__":
 
     assert(os.path.isfile(experiment_path))
 
-    CHANGE_DETECTOR_N      = 25
-    CHANGE_DETECTOR_BARN   = 10
-    CHANGE_DETECTOR_ALPHA0 = 0.001
-    CHANGE_DETECTOR_SIGMA  = 1.0
+    if options.sweep:
+        grid = {'N' : [CHANGE_DETECTOR_N], 'barN' : [CHANGE_DETECTOR_BARN], 'alpha0' : [CHANGE_DETECTOR_ALPHA0], 'sigma' : [CHANGE_DETECTOR_SIGMA]}
+        try:
+            for entry in options.sweep.split(';'):
+                name, sep, values = entry.partition('=')
+                name = name.strip()
+                if name not in grid:
+                    raise ValueError
+                cast = int if name in ('N', 'barN') else float
+                grid[name] = [cast(v) for v in values.split(',')]
+        except ValueError:
+            print "error: cannot parse the sweep grid \"%s\"." % options.sweep
+            sys.exit(0)
+
+        results = change_detection.sweep.sweep(options.site, experiment_path, grid['N'], grid['barN'], grid['alpha0'], grid['sigma'],
+                                               change_epoch=options.change_epoch, jobs=options.jobs, use_cache=options.use_cache)
+        change_detection.sweep.print_summary(results)
+        sys.exit(0)
 
-    network = change_detection.Network(options.site, experiment_path, CHANGE_DETECTOR_N, CHANGE_DETECTOR_BARN, CHANGE_DETECTOR_ALPHA0, CHANGE_DETECTOR_SIGMA, output_split_logs=options.output_split_logs)
+    network = change_detection.Network(options.site, experiment_path, CHANGE_DETECTOR_N, CHANGE_DETECTOR_BARN, CHANGE_DETECTOR_ALPHA0, CHANGE_DETECTOR_SIGMA, output_split_logs=options.output_split_logs, use_cache=options.use_cache, jobs=options.jobs)
     if not network.initialized():
         print "warning: cannot initialize network."
         sys.exit(0)
 
-    network.draw_graph()
+    network.draw_graph(jobs=options.jobs, save_frames=options.save_frames)
 
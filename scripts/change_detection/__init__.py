@@ -20,5 +20,18 @@
 #    3. This notice may not be removed or altered from any source
 #    distribution.
 
-from network import Network
-from grapher import draw_graph
+#
+# The submodules are not imported here: network and grapher pull in numpy,
+# networkx and matplotlib, while export and calibration must stay usable
+# without them. Import the submodules you need (e.g. change_detection.sweep);
+# Network and draw_graph import theirs on first use.
+#
+
+def Network(*args, **kwargs):
+    from network import Network
+    return Network(*args, **kwargs)
+
+
+def draw_graph(*args, **kwargs):
+    from grapher import draw_graph
+    return draw_graph(*args, **kwargs)
@@ -0,0 +1,107 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Persistent adjacency of the change-detection network
+#
+# The packets received in an epoch are kept in two dense weight matrices
+# (sync and data) indexed by the position of the node ids in `ids`: entry
+# [i, j] counts the packets node ids[i] received from node ids[j]. At every
+# epoch only the entries set in the previous epoch are cleared and the new
+# ones added.
+#
+# The networkx graph, with the `pos` node attribute and the `sync_weight` and
+# `data_weight` edge attributes, is built only when asked for.
+#
+# ! the update is a small part of Network.step(), the change tests of the
+#   nodes cost several times more
+#
+
+import numpy
+
+
+class Adjacency(object):
+    def __init__(self, ids, positions):
+        assert len(ids) == len(positions)
+
+        self._ids = list(ids)
+        self._index = dict((nodeid, i) for i, nodeid in enumerate(self._ids))
+        self._positions = numpy.array(positions, dtype = float)
+
+        n = len(self._ids)
+        self._weights = {'sync' : numpy.zeros((n, n)), 'data' : numpy.zeros((n, n))}
+        self._touched = {'sync' : None, 'data' : None}
+
+        self._graph = None
+
+    def ids(self):
+        return self._ids
+
+    def index(self, nodeid):
+        """Return the matrix index of nodeid, or None if it is unknown."""
+        return self._index.get(nodeid)
+
+    def positions(self):
+        return self._positions
+
+    def weights(self, kind):
+        return self._weights[kind]
+
+    def update(self, kind, receivers, senders):
+        """Replace the `kind` weights with one packet for each pair of
+        receiver and sender indexes.
+        """
+        w = self._weights[kind]
+        if self._touched[kind] is not None:
+            w[self._touched[kind]] = 0.
+
+        rows = numpy.asarray(receivers, dtype = int)
+        cols = numpy.asarray(senders, dtype = int)
+        numpy.add.at(w, (rows, cols), 1.)
+        self._touched[kind] = (rows, cols)
+        self._graph = None
+
+    def edges(self, kind):
+        """Return the (receiver id, sender id) pairs and the weights of the
+        `kind` edges.
+        """
+        w = self._weights[kind]
+        rows, cols = numpy.nonzero(w)
+        return ([(self._ids[i], self._ids[j]) for i, j in zip(rows, cols)], w[rows, cols].tolist())
+
+    def to_networkx(self):
+        if self._graph is not None:
+            return self._graph
+
+        import networkx as nx
+
+        G = nx.DiGraph()
+        G.add_nodes_from((nodeid, {'pos' : self._positions[i].tolist()}) for i, nodeid in enumerate(self._ids))
+        for kind in ('data', 'sync'):
+            attr = kind + '_weight'
+            edges, weights = self.edges(kind)
+            G.add_edges_from((i, j, {attr : w}) for (i, j), w in zip(edges, weights))
+
+        self._graph = G
+        return G
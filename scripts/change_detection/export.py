@@ -0,0 +1,237 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Columnar export of the per-epoch node states and links
+#
+# The state of the network in every rendered epoch is appended to a folder of
+# raw column files (native byte order, see the `columns` entry of the json
+# index for their numpy dtypes)
+#
+# - positions.node, positions.x, positions.y: the node positions (constant)
+# - nodes.epoch, nodes.node, nodes.state, nodes.first_k: one entry per node
+#   and epoch, state is one of the NODE_STATE_* below and first_k the first
+#   alarmed neighborhood (1-based, 0 if the node raised no alarm)
+# - epochs.epoch, epochs.edge_offset: the epochs appended so far and the
+#   index of their first edge, the edges of the i-th epoch are in
+#   [edge_offset[i], edge_offset[i+1])
+# - edges.receiver, edges.sender, edges.kind, edges.weight: the packets
+#   node `receiver` got from `sender` over the data (kind 0) or sync
+#   (kind 1) channel
+#
+# Every append() writes and flushes all the columns of one epoch: the lengths
+# of the columns are given by the file sizes, there is nothing to finalize.
+# The columns can be memory-mapped with memmap() while the export grows.
+#
+# to_text() regenerates the legacy %d.NodesPositions and %d.LinksList files.
+#
+# ! this module must not depend on numpy or on the plotting stack: the
+#   exports are read by light tools such as scripts/states-to-text.py
+#
+
+import os
+import sys
+import json
+from array import array
+
+EXPORT_VERSION = 1
+
+# the values of nodes.state, they are node.AGENT_STATE_*
+NODE_STATE_STARTINGUP = 0
+NODE_STATE_SS = 1
+NODE_STATE_SLEEPING = 2
+
+EDGE_KIND_DATA = 0
+EDGE_KIND_SYNC = 1
+
+_COLUMNS = (
+    ('positions.node', 'i'), ('positions.x', 'd'), ('positions.y', 'd'),
+    ('nodes.epoch', 'i'), ('nodes.node', 'i'), ('nodes.state', 'b'), ('nodes.first_k', 'H'),
+    ('epochs.epoch', 'i'), ('epochs.edge_offset', 'I'),
+    ('edges.receiver', 'i'), ('edges.sender', 'i'), ('edges.kind', 'B'), ('edges.weight', 'H'),
+    )
+
+_NUMPY_KINDS = {'b' : 'i', 'B' : 'u', 'H' : 'u', 'i' : 'i', 'I' : 'u', 'd' : 'f'}
+
+
+def _dtype(typecode):
+    return '%s%s%d' % ('<' if sys.byteorder == 'little' else '>', _NUMPY_KINDS[typecode], array(typecode).itemsize)
+
+
+class StateExport(object):
+    def __init__(self, export_dir, positions, params):
+        """Start a new export in export_dir.
+
+        positions maps the node ids to their (x, y), params is stored as is in
+        the index.
+        """
+        if not os.path.isdir(export_dir):
+            os.mkdir(export_dir)
+
+        self._dir = export_dir
+        self._files = {}
+        for name, typecode in _COLUMNS:
+            self._files[name] = open(os.path.join(export_dir, name), 'wb')
+
+        self._nr_edges = 0
+
+        ids = sorted(positions.keys())
+        self._write('positions.node', ids)
+        self._write('positions.x', [positions[nodeid][0] for nodeid in ids])
+        self._write('positions.y', [positions[nodeid][1] for nodeid in ids])
+        self._flush()
+
+        index = {
+            'version' : EXPORT_VERSION,
+            'columns' : dict((name, _dtype(typecode)) for name, typecode in _COLUMNS),
+            'params' : params,
+            }
+        with open(os.path.join(export_dir, 'index'), 'w') as f:
+            json.dump(index, f)
+
+    def _write(self, name, values):
+        array(dict(_COLUMNS)[name], values).tofile(self._files[name])
+
+    def _flush(self):
+        for f in self._files.values():
+            f.flush()
+
+    def append(self, s):
+        """Append the FrameState s."""
+        agent_states = s.agent_states
+        ids = sorted(agent_states.keys())
+        self._write('nodes.epoch', [s.t]*len(ids))
+        self._write('nodes.node', ids)
+        self._write('nodes.state', [agent_states[nodeid] for nodeid in ids])
+        self._write('nodes.first_k', [s.alarmed_data.get(nodeid, 0) for nodeid in ids])
+
+        self._write('epochs.epoch', [s.t])
+        self._write('epochs.edge_offset', [self._nr_edges])
+
+        for kind, edges, weights in ((EDGE_KIND_DATA, s.data_edges, s.data_weights), (EDGE_KIND_SYNC, s.sync_edges, s.sync_weights)):
+            self._write('edges.receiver', [e[0] for e in edges])
+            self._write('edges.sender', [e[1] for e in edges])
+            self._write('edges.kind', [kind]*len(edges))
+            self._write('edges.weight', [int(w) for w in weights])
+            self._nr_edges += len(edges)
+
+        self._flush()
+
+    def close(self):
+        for f in self._files.values():
+            f.close()
+        self._files = {}
+
+
+def _read_index(export_dir):
+    with open(os.path.join(export_dir, 'index')) as f:
+        index = json.load(f)
+    if index['version'] != EXPORT_VERSION:
+        raise ValueError("unsupported export version %s" % index['version'])
+    return index
+
+
+def load(export_dir):
+    """Return the index and a dict with the columns as arrays."""
+    index = _read_index(export_dir)
+
+    columns = {}
+    for name, typecode in _COLUMNS:
+        col = array(typecode)
+        path = os.path.join(export_dir, name)
+        with open(path, 'rb') as f:
+            col.fromfile(f, os.path.getsize(path)//col.itemsize)
+        columns[name] = col
+
+    return (index, columns)
+
+
+def memmap(export_dir):
+    """Return the index and a dict with the columns as read-only numpy
+    memory maps.
+    """
+    import numpy
+
+    index = _read_index(export_dir)
+
+    columns = {}
+    for name, dtype in index['columns'].items():
+        path = os.path.join(export_dir, name)
+        if os.path.getsize(path):
+            columns[name] = numpy.memmap(path, dtype = dtype, mode = 'r')
+        else:
+            columns[name] = numpy.zeros(0, dtype = dtype)
+
+    return (index, columns)
+
+
+def to_text(export_dir, frames_dir):
+    """Write the legacy %d.NodesPositions and %d.LinksList files of every
+    epoch in the export to frames_dir.
+    """
+    index, c = load(export_dir)
+    if not os.path.isdir(frames_dir):
+        os.mkdir(frames_dir)
+
+    pos = dict((nodeid, (x, y)) for nodeid, x, y in zip(c['positions.node'], c['positions.x'], c['positions.y']))
+
+    # the node entries of each epoch are contiguous
+    nodes_at_epoch = {}
+    for i, epoch in enumerate(c['nodes.epoch']):
+        nodes_at_epoch.setdefault(epoch, []).append(i)
+
+    nr_epochs = len(c['epochs.epoch'])
+    nr_edges = len(c['edges.receiver'])
+    for e in xrange(nr_epochs):
+        t = c['epochs.epoch'][e]
+
+        nodepos_str = "x y s1"
+        for i in nodes_at_epoch.get(t, []):
+            nodeid = c['nodes.node'][i]
+            first_k = c['nodes.first_k'][i]
+
+            state = -1
+            if c['nodes.state'][i] == NODE_STATE_SS:
+                state = first_k
+
+            if state > -1:
+                x, y = pos[nodeid]
+                nodepos_str +='\n'
+                nodepos_str +='%.5f %.5f %d' % (x,y, state)
+
+        file('%s/%d.NodesPositions' % (frames_dir,t), 'w').write(nodepos_str)
+
+        linkslist_str = "xstart ystart towardsx towardsy"
+        end = c['epochs.edge_offset'][e+1] if e+1 < nr_epochs else nr_edges
+        for k in xrange(c['epochs.edge_offset'][e], end):
+            if c['edges.kind'][k] != EDGE_KIND_DATA:
+                continue
+
+            xi, yi = pos[c['edges.receiver'][k]]
+            xj, yj = pos[c['edges.sender'][k]]
+
+            linkslist_str +='\n'
+            linkslist_str +='%.5f %.5f %.5f %.5f' % (xi, yi, xj-xi, yj-yi)
+
+        file('%s/%d.LinksList' % (frames_dir,t), 'w').write(linkslist_str)
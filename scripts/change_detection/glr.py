@@ -0,0 +1,158 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+#
+# Vectorized GLR engine of the change detector
+#
+# For every candidate change time T in [1, N-barN+1] and every k the test
+# computes, at once, the pre-change size estimate barS = M(N+1-T)/sum(X) over
+# the epochs t-N,...,t-T and the log-GLR of a size drop below sigma*barS over
+# the epochs t-T+1,...,t. The T with the minimum log-GLR is the estimated
+# change time and an alarm is raised when the minimum is below the threshold
+# log(lambda_T).
+#
+# The statistics of the last N+1 epochs are kept in
+# ring buffers (GLRWindow). glr_test() works on arrays with any number of
+# leading dimensions: Network.step() stacks the windows of all nodes to run
+# a single test per epoch.
+#
+# ! the floating point operations are done in the same order as in the
+#   original scalar loops (the sums over idx are sequential cumulative
+#   sums): the results are identical
+#
+
+import numpy
+
+
+class GLRWindow(object):
+    """Ring buffers with X, S = M/X and M*log(X) of the last N+1 epochs."""
+
+    def __init__(self, M, D, N):
+        assert isinstance(M, int) and M > 0
+        assert isinstance(D, int) and D > 0
+        assert isinstance(N, int) and N > 0
+
+        self._M = M
+        self._len = N + 1
+        self._x = numpy.zeros((D, N + 1))
+        self._S = numpy.zeros((D, N + 1))
+        self._M_log_x = numpy.zeros((D, N + 1))
+        self.reset()
+
+    def reset(self):
+        # position of X(t-N) and number of valid epochs
+        self._head = 0
+        self._count = 0
+
+    def full(self):
+        return self._count == self._len
+
+    def push(self, X, S):
+        if self._count < self._len:
+            pos = (self._head + self._count) % self._len
+            self._count += 1
+        else:
+            pos = self._head
+            self._head = (self._head + 1) % self._len
+
+        self._x[:, pos] = X
+        self._S[:, pos] = S
+        self._M_log_x[:, pos] = self._M*numpy.log(X)
+
+    def _order(self):
+        return (numpy.arange(self._count) + self._head) % self._len
+
+    def get(self):
+        """Return (X, S, M*log(X)) with shape (D, epochs), oldest epoch first."""
+        order = self._order()
+        return (self._x[:, order], self._S[:, order], self._M_log_x[:, order])
+
+    def S_traj(self, k):
+        return self._S[k, self._order()].tolist()
+
+
+def _take_last_axis(a, index):
+    # a[..., index[...]]
+    flat = a.reshape(-1, a.shape[-1])
+    return flat[numpy.arange(flat.shape[0]), index.ravel()].reshape(index.shape)
+
+
+def change_times(N, barN):
+    """Return the candidate change times, in the order the test scans them."""
+    return numpy.arange(N - barN + 1, 0, -1)
+
+
+def glr_log_lambdas(x, S, M_log_x, M, N, barN, sigma):
+    """Return the pre-change size estimates barS and the log-GLRs of every
+    candidate change time (see change_times()).
+
+    x, S and M_log_x have shape (..., N+1), oldest epoch first. The returned
+    arrays have shape (..., N-barN+1).
+    """
+    assert x.shape[-1] == N + 1
+    assert x.shape == S.shape == M_log_x.shape
+
+    M__1_minus_logM__ = M*(1. - numpy.log(M))
+
+    T = change_times(N, barN)
+
+    # barS for every T, from the sum of X(t-N),...,X(t-T)
+    x_cumsum = numpy.cumsum(x, axis=-1)
+    barS = (M*(N + 1 - T)).astype(float)/x_cumsum[..., N - T]
+    sigma_barS = sigma*barS
+    M_log_sigma_barS_over_M_plus_1 = M*(numpy.log(sigma_barS)) + M__1_minus_logM__
+
+    # the log-GLR terms of every (T, idx), masked to idx in [N-T+1, N] and
+    # S(idx) < sigma*barS
+    idx = numpy.arange(N + 1)
+    in_window = idx[numpy.newaxis, :] >= (N - T + 1)[:, numpy.newaxis]
+    below = S[..., numpy.newaxis, :] < sigma_barS[..., numpy.newaxis]
+    terms = M_log_sigma_barS_over_M_plus_1[..., numpy.newaxis] - sigma_barS[..., numpy.newaxis]*x[..., numpy.newaxis, :] + M_log_x[..., numpy.newaxis, :]
+    terms = numpy.where(in_window & below, terms, 0.)
+    LogLambda = numpy.cumsum(terms, axis=-1)[..., -1]
+    return (barS, LogLambda)
+
+
+def glr_test(x, S, M_log_x, M, N, barN, sigma, log_lambdas):
+    """Run the GLR test on windows of N+1 epochs.
+
+    x, S and M_log_x have shape (..., N+1), oldest epoch first. Return the
+    arrays change_time, pre_change_size, loglambda and alarm with shape (...).
+    """
+    barS, LogLambda = glr_log_lambdas(x, S, M_log_x, M, N, barN, sigma)
+
+    T = change_times(N, barN)
+    nr_T = len(T)
+
+    # the scalar loop keeps the last T (in scan order) with the minimum
+    # log-GLR, if not positive
+    minLogLambda = LogLambda.min(axis=-1)
+    last = nr_T - 1 - numpy.argmax((LogLambda == minLogLambda[..., numpy.newaxis])[..., ::-1], axis=-1)
+    found = minLogLambda <= 0.
+
+    change_time = numpy.where(found, T[last], 1)
+    pre_change_size = numpy.where(found, _take_last_axis(barS, last), 0.)
+    loglambda = numpy.where(found, minLogLambda, 0.)
+    alarm = loglambda < numpy.asarray(log_lambdas)[change_time - 1]
+
+    return (change_time, pre_change_size, loglambda, alarm.astype(int))
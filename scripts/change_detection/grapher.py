@@ -20,31 +20,193 @@
 #    3. This notice may not be removed or altered from any source
 #    distribution.
 
+
+#
+# Render the change-detection network into a video
+#
+# The network is stepped serially (the change detector is sequential) and the
+# state needed to draw each epoch is collected in a FrameState. The frames are
+# then rendered by a pool of worker processes (the constant drawing arguments
+# are left in _render_args before the pool forks) and streamed in epoch order,
+# as raw rgb images, over a pipe to the video encoder.
+#
+# The frame states are also appended to the columnar export in the `states`
+# folder (see export.py) while the network is stepped. When save_frames is
+# True each frame is also saved to the frames folder as a jpeg.
+#
+
 import os
+import sys
 import time
 import signal
 import shutil
+import subprocess
+import multiprocessing
 import numpy
 
+import matplotlib
+# ! the frames are rendered off-screen by the workers
+matplotlib.use('Agg')
 from matplotlib import rc
 rc('font', family='serif')
 import matplotlib.pyplot as plt
 
+# ! networkx >= 2 draws every directed edge as a FancyArrowPatch: with the
+#   thousands of edges of a large site a frame takes tens of seconds instead of
+#   a fraction of a second
 import networkx as nx
 
 import node
+import export
+
+# the agent states are exported as they are
+assert (node.AGENT_STATE_STARTINGUP, node.AGENT_STATE_SS, node.AGENT_STATE_SLEEPING) == \
+    (export.NODE_STATE_STARTINGUP, export.NODE_STATE_SS, export.NODE_STATE_SLEEPING)
 
 NODE_SIZE = 200
+FIG_SIZE = (7.5,7.5)
+VIDEO_RATE = 2
+
+SYNC_EDGE_MULT = 0.75
+DATA_EDGE_MULT = 0.15
+
+color_sleeping = (0.75,0.75,0.75)
+color_active = (1,1,1)
+color_starting = (1,0.9,0.)
+color_alarmed = (1,0.1,0.1)
+
+
+class FrameState(object):
+    """What is drawn in the frame of epoch t."""
+    def __init__(self, t, D, agents, adjacency):
+        self.t = t
+
+        self.actives = []
+        self.alarmed = []
+        self.alarms_count = 0
+        self.alarmed_colors = []
+        self.alarmed_data = {}
+        self.starting = []
+        self.sleeping = []
+        self.agent_states = {}
+
+        self.min_first_k = D + 1
+        self.max_first_k = 0
+        self.min_last_k = D + 1
+        self.max_last_k = 0
+        for nodeid, agent in agents.items():
+            state2 = agent.state2()
+            self.agent_states[nodeid] = state2
+            if state2 == node.AGENT_STATE_STARTINGUP:
+                self.starting.append(nodeid)
+            elif state2 == node.AGENT_STATE_SS:
+                info = agent.test_info()
+                assert info is not None
+
+                change_time, pre_change_size, loglambda, alarm = info
+                alarm = list(alarm)
+                # discard info on the first x-step neighborhoods:
+                x=1
+                for i in xrange(0,x):
+                    alarm[i]=0
+
+                sum_alarm = numpy.sum(alarm)
+                if sum_alarm > 0:
+                    self.alarms_count += sum_alarm
+                    self.alarmed.append(nodeid)
+                    first_k = alarm.index(1)
+                    last_k = D - alarm[::-1].index(1)
+                    self.min_first_k = min(self.min_first_k, first_k+1)
+                    self.max_first_k = max(self.max_first_k, first_k+1)
+                    self.min_last_k = min(self.min_last_k, last_k)
+                    self.max_last_k = max(self.max_last_k, last_k)
+
+                    self.alarmed_data[nodeid] = first_k + 1
+
+                    self.alarmed_colors.append((1. - float(first_k)/float(D),0.1,0.1))
+                else:
+                    self.actives.append(nodeid)
+
+            elif state2 == node.AGENT_STATE_SLEEPING:
+                self.sleeping.append(nodeid)
+
+        self.data_edges, self.data_weights = adjacency.edges('data')
+        self.sync_edges, self.sync_weights = adjacency.edges('sync')
+
+
+_render_args = None
+_fig = None
+
+def _render_frame(s):
+    global _fig
+    pos, nr_agents, title, frames_dir = _render_args
+
+    if _fig is None:
+        _fig = plt.figure(figsize=FIG_SIZE)
+    fig = _fig
+
+    # setup figure for this iteration
+    fig.clf()
+    fig.patch.set_facecolor((1,1,1))
+    fig_border_width = 0.075
+    ax = fig.add_axes([fig_border_width, fig_border_width, 1-2*fig_border_width, 1-2*fig_border_width])
+    ax.axis('off')
+
+    graph = nx.DiGraph()
+    graph.add_nodes_from(pos.keys())
+    graph.add_edges_from(s.data_edges)
+    graph.add_edges_from(s.sync_edges)
+
+    # Draw the network edges and nodes
+    data_weights = [x*DATA_EDGE_MULT for x in s.data_weights]
+    sync_weights = [x*SYNC_EDGE_MULT for x in s.sync_weights]
+
+    nx.draw_networkx_edges(graph, pos, s.data_edges, edge_color='r', width=data_weights, alpha=0.25, ax=ax)
+    nx.draw_networkx_edges(graph, pos, s.sync_edges, edge_color='y', width=sync_weights, alpha=0.25, ax=ax)
+
+    def _draw_nodes(ids, color):
+        if len(ids) == len(color):
+            for i in ids:
+                nx.draw_networkx_nodes(graph, pos, [i],  NODE_SIZE, node_color=color, ax=ax)
+        else:
+            nx.draw_networkx_nodes(graph, pos, ids, NODE_SIZE, node_color=color, ax=ax)
+
+    _draw_nodes(s.actives, color_active)
+    _draw_nodes(s.starting, color_starting)
+    _draw_nodes(s.sleeping, color_sleeping)
+
+    if len(s.alarmed) == len(color_alarmed):
+        for k in s.alarmed:
+            nx.draw_networkx_nodes(graph, pos, [k],  NODE_SIZE, node_color=s.alarmed_colors, ax=ax)
+    else:
+        nx.draw_networkx_nodes(graph, pos, s.alarmed,  NODE_SIZE, node_color=s.alarmed_colors, ax=ax)
+
+    # Text overlays
+    fig.text(0.5, 0.925, title, family='serif', size=15, ha='center')
+
+    stats_string = "$\\mathrm{epoch} \, %d,\; \mathrm{active}\, %d/%d,\;  \mathrm{alarms}\, %d/%d,\;$" % (s.t, len(s.actives) + len(s.alarmed) + len(s.starting), nr_agents, len(s.alarmed), s.alarms_count)
+    if len(s.alarmed):
+        stats_string = ''.join([stats_string, "$\\lfloor k \\rfloor \, %d\leftrightarrow %d \; \\lceil k \\rceil \, %d\leftrightarrow %d$" % (s.min_first_k, s.max_first_k, s.min_last_k, s.max_last_k, )])
+    else:
+        stats_string = ''.join([stats_string, "$\\lfloor k \\rfloor \, \cdot\leftrightarrow \cdot \; \\lceil k \\rceil \, \cdot\leftrightarrow\cdot$"])
+    fig.text(0.05, 0.05, stats_string, family='serif', size=15)
+
+    fig.canvas.draw()
+
+    if frames_dir is not None:
+        fig.savefig('%s/%.4d.jpg' % (frames_dir,s.t))
 
+    width, height = fig.canvas.get_width_height()
+    return (width, height, fig.canvas.tostring_rgb())
 
-def draw_graph(network, experiment_path):
+
+def draw_graph(network, experiment_path, jobs = 1, save_frames = False):
     assert os.path.isfile(experiment_path)
     experiment_dir = os.path.dirname(experiment_path)
     assert os.path.isdir(experiment_dir)
     assert network is not None
+    assert jobs >= 1
 
-    experiment_filename = os.path.basename(experiment_path)
-    
     M = network.get_M()
     D = network.get_D()
     N = network.get_N()
@@ -57,13 +219,13 @@ def draw_graph(network, experiment_path):
     sim_dir = os.path.join(experiment_dir, simid_base)
     frames_dir = '%s/frames' % sim_dir
     video_path = '%s/%s.avi' % (sim_dir, simid_base)
-    video_cmd = "avconv -y -r 2 -i %s/%%04d.jpg -b 2000k %s" % (frames_dir, video_path)
 
     if os.path.exists(sim_dir):
         shutil.rmtree(sim_dir)
 
     os.mkdir(sim_dir)
-    os.mkdir(frames_dir)
+    if save_frames:
+        os.mkdir(frames_dir)
 
     # Install SIGINT handler so that a video is produced even
     # if the user aborts the current simulation
@@ -74,195 +236,71 @@ def draw_graph(network, experiment_path):
         print '\nStopping simulation ...'
         global simulation_stop
         simulation_stop = True
-        
-    signal.signal(signal.SIGINT,handler_sig_term)
 
+    signal.signal(signal.SIGINT,handler_sig_term)
 
     agents = network.get_nodes()
+    adjacency = network.get_adjacency()
+    pos = dict((nodeid, tuple(xy)) for nodeid, xy in zip(adjacency.ids(), adjacency.positions().tolist()))
 
-    # Create the figure
-    fig = plt.figure(figsize=(7.5,7.5))   
-    plt.ion()
-    plt.show()
-
-    edge_color = (0.9,0.9,0.9)
-    color_sleeping = (0.75,0.75,0.75)
-    color_active = (1,1,1)
-    color_starting = (1,0.9,0.)
-    color_alarmed = (1,0.1,0.1)
-
+    params = {'M' : M, 'D' : D, 'N' : N, 'barN' : barN, 'alpha_0' : alpha_0, 'sigma' : sigma}
+    states_export = export.StateExport(os.path.join(sim_dir, 'states'), pos, params)
 
+    #
+    # step the network and collect the state of every frame
+    #
+    states = []
     STOP_EPOCH = network.last_epoch()
     for h in xrange(1,STOP_EPOCH+1):
         if simulation_stop:
             # user sent us SIGINT, exit simulation loop
             break
 
-        # step the network
-        graph = network.step()
+        adjacency = network.step()
         t = network.get_epoch()
         print 'epoch %d/%d' % (t, STOP_EPOCH)
-
-        # setup figure for this iteration
-        fig.clf()
-        fig.patch.set_facecolor((1,1,1))
-        fig_border_width = 0.075
-        ax = fig.add_axes([fig_border_width, fig_border_width, 1-2*fig_border_width, 1-2*fig_border_width])
-        plt.axis('off')
-
-
-        # Collect statistics to be displayed
-        actives = []
-        alarmed = []    
-        alarms_count = 0
-        alarmed_colors = []
-        alarmed_data = {}
-        starting = []
-        sleeping = []
-
-        min_first_k = D + 1
-        max_first_k = 0
-        min_last_k = D + 1
-        max_last_k = 0
-        for nodeid, agent in agents.items():
-            state2 = agent.state2()
-            if state2 == node.AGENT_STATE_STARTINGUP:
-                starting.append(nodeid)
-            elif state2 == node.AGENT_STATE_SS:
-                info = agent.test_info()
-                assert info is not None
-          
-                change_time, pre_change_size, loglambda, alarm = info
-                # discard info on the first x-step neighborhoods:
-                x=1
-                for i in xrange(0,x):
-                    alarm[i]=0
-
-                sum_alarm = numpy.sum(alarm)
-                if sum_alarm > 0:
-                    alarms_count += sum_alarm
-                    alarmed.append(nodeid)
-                    first_k = alarm.index(1) 
-                    alarm.reverse()
-                    last_k = D - alarm.index(1)
-                    alarm.reverse()
-                    min_first_k = min(min_first_k, first_k+1)
-                    max_first_k = max(max_first_k, first_k+1)
-                    min_last_k = min(min_last_k, last_k)
-                    max_last_k = max(max_last_k, last_k)
-
-                    alarmed_data[nodeid] = first_k + 1
-                    
-                    alarmed_colors.append((1. - float(first_k)/float(D),0.1,0.1))
-                else:
-                    actives.append(nodeid)
-          
-            elif state2 == node.AGENT_STATE_SLEEPING:
-                sleeping.append(nodeid)
-
-        # Skip a few frames
-        #if t< 18:
-        #    continue
-
-        pos = nx.get_node_attributes(graph,'pos')
-        
-        # Draw the network edges and nodes
-        data_weights = nx.get_edge_attributes(graph,'data_weight')
-        sync_weights = nx.get_edge_attributes(graph,'sync_weight')
-        data_edges = data_weights.keys()
-        sync_edges = sync_weights.keys()
-        #print 'sync_edges', sync_edges, 'sync_weights', sync_weights
-        #print 'data_edges', data_edges, 'data_weights', data_weights
-        #width_data = []
-        #for edge in edges:
-        #    width_data.append(graph[edge[0]][edge[1]]['data_weight'])
-        SYNC_EDGE_MULT = 0.75
-        DATA_EDGE_MULT = 0.15
-        data_weights = [x*DATA_EDGE_MULT for x in data_weights.values()]
-        sync_weights = [x*SYNC_EDGE_MULT for x in sync_weights.values()]
-
-        nx.draw_networkx_edges(graph, pos, data_edges, edge_color='r', width=data_weights, alpha=0.25, ax=ax)
-        nx.draw_networkx_edges(graph, pos, sync_edges, edge_color='y', width=sync_weights, alpha=0.25, ax=ax)
-
-
-        def _draw_nodes(ids, color):
-            if len(ids) == len(color):
-                for i in ids:
-                    nx.draw_networkx_nodes(graph, pos, [i],  NODE_SIZE, node_color=color, ax=ax)    
-            else:
-                nx.draw_networkx_nodes(graph, pos, ids, NODE_SIZE, node_color=color, ax=ax)
-
-        _draw_nodes(actives, color_active)
-        _draw_nodes(starting, color_starting)
-        _draw_nodes(sleeping, color_sleeping)
-        #_draw_nodes(alarmed, alarmed_colors)
-
-        if len(alarmed) == len(color_alarmed):
-            for k in alarmed:
-                nx.draw_networkx_nodes(graph, pos, [k],  NODE_SIZE, node_color=alarmed_colors, ax=ax)   
-        else:
-            nx.draw_networkx_nodes(graph, pos, alarmed,  NODE_SIZE, node_color=alarmed_colors, ax=ax)    
-
-
-        # Text overlays
-        plt.figtext(0.5, 0.925, "$M\,%d,\; \\alpha_0\, %.3f,\; D\, %d,\; N\, %d,\; \\overline{N}\, %d,\; \\sigma \, %.2f$" % (M, alpha_0, D, N, barN, sigma), family='serif', size=15, ha='center')
-
-        stats_string = "$\\mathrm{epoch} \, %d,\; \mathrm{active}\, %d/%d,\;  \mathrm{alarms}\, %d/%d,\;$" % (t, len(actives) + len(alarmed) + len(starting), len(agents), len(alarmed), alarms_count)
-        if len(alarmed):
-            stats_string = ''.join([stats_string, "$\\lfloor k \\rfloor \, %d\leftrightarrow %d \; \\lceil k \\rceil \, %d\leftrightarrow %d$" % (min_first_k, max_first_k, min_last_k, max_last_k, )])
-        else:
-            stats_string = ''.join([stats_string, "$\\lfloor k \\rfloor \, \cdot\leftrightarrow \cdot \; \\lceil k \\rceil \, \cdot\leftrightarrow\cdot$"])
-        plt.figtext(0.05, 0.05, stats_string, family='serif', size=15)
-
-        # Axis-limits
-        #plt.xlim((-float(grid_side)*0.1, float(grid_side-1)*1.1))
-        #plt.ylim((-float(grid_side)*0.1, float(grid_side-1)*1.1))
-        #plt.xlim(-0.1,2.6)
-        #plt.ylim(-0.1,2.6)
-        fig.canvas.draw()
-
-        nodepos_str = "x y s1"
-        for nodeid, agent in agents.items():
-
-            xy = graph.node[nodeid]['pos']
-            x = xy[0]
-            y = xy[1]
-
-            state = -1
-            if nodeid in actives:
-                state = 0
-
-            if nodeid in alarmed:
-                assert nodeid in alarmed_data
-
-                state = alarmed_data[nodeid]
-                assert state > 0
-
-            if state > -1:
-                nodepos_str +='\n'
-                nodepos_str +='%.5f %.5f %d' % (x,y, state)
-
-
-        file('%s/%d.NodesPositions' % (frames_dir,t), 'w').write(nodepos_str)
-    
-        linkslist_str = "xstart ystart towardsx towardsy"
-        for e in data_edges:
-            i = e[0]
-            j = e[1]
-            xy = graph.node[i]['pos']
-            xi = xy[0]
-            yi = xy[1]
-
-            xy = graph.node[j]['pos']
-            xj = xy[0]
-            yj = xy[1]
-
-            linkslist_str +='\n'
-            linkslist_str +='%.5f %.5f %.5f %.5f' % (xi, yi, xj-xi, yj-yi)
-
-        file('%s/%d.LinksList' % (frames_dir,t), 'w').write(linkslist_str)
-
-        plt.savefig('%s/%.4d.jpg' % (frames_dir,t))
-    
-    # Call avconv to make a video from the saved frames
-    os.system(video_cmd)
+        states.append(FrameState(t, D, agents, adjacency))
+        states_export.append(states[-1])
+
+    states_export.close()
+
+    if not len(states):
+        return
+
+    #
+    # render the frames and pipe them to the encoder
+    #
+    global _render_args
+    title = "$M\,%d,\; \\alpha_0\, %.3f,\; D\, %d,\; N\, %d,\; \\overline{N}\, %d,\; \\sigma \, %.2f$" % (M, alpha_0, D, N, barN, sigma)
+    _render_args = (pos, len(agents), title, frames_dir if save_frames else None)
+
+    # the workers ignore SIGINT, the parent stops feeding the encoder
+    handler = signal.signal(signal.SIGINT, signal.SIG_IGN)
+    pool = multiprocessing.Pool(jobs)
+    signal.signal(signal.SIGINT, handler)
+
+    encoder = None
+    start = time.time()
+    nr_frames = 0
+    try:
+        for width, height, rgb in pool.imap(_render_frame, states, chunksize = 1):
+            if simulation_stop:
+                break
+
+            if encoder is None:
+                video_cmd = ['avconv', '-y', '-f', 'rawvideo', '-pix_fmt', 'rgb24', '-s', '%dx%d' % (width, height),
+                             '-r', str(VIDEO_RATE), '-i', '-', '-b', '2000k', video_path]
+                encoder = subprocess.Popen(video_cmd, stdin = subprocess.PIPE)
+
+            encoder.stdin.write(rgb)
+            nr_frames += 1
+            print 'frame %d/%d' % (nr_frames, len(states))
+    finally:
+        pool.terminate()
+        _render_args = None
+        if encoder is not None:
+            encoder.stdin.close()
+            encoder.wait()
+
+    elapsed = time.time() - start
+    print "Rendered %d frames in %.1f s (%.2f frames/s) with %d jobs" % (nr_frames, elapsed, nr_frames/max(elapsed, 1e-3), jobs)
@@ -20,29 +20,78 @@
 #    3. This notice may not be removed or altered from any source
 #    distribution.
 
+import sys
 import numpy
-import networkx as nx
+import multiprocessing
+from StringIO import StringIO
 import senslab
 from node import Node
+import glr
+from adjacency import Adjacency
 import grapher
 
+#
+# Parallel node loading
+#
+# The nodes are loaded by a pool of worker processes: the arguments are left in
+# _load_args before the pool forks so that only the node ids are sent to the
+# workers. The output of each worker is captured and printed by the parent in
+# node id order.
+#
+# ! the loaded nodes are pickled back to the parent: with a single cpu the pool
+#   is slower than loading the nodes serially
+#
+_load_args = None
+
+def _load_node(nodeid):
+    site, nodelogs, N, barN, alpha_0, sigma = _load_args
+
+    stdout = sys.stdout
+    sys.stdout = StringIO()
+    try:
+        node = Node(site, nodeid, nodelogs[nodeid], N, barN, alpha_0, sigma)
+        return (node, sys.stdout.getvalue())
+    finally:
+        sys.stdout = stdout
+
+
 class Network(senslab.Network):
-    def __init__(self, site, log_path, N, barN, alpha_0, sigma, output_split_logs = False):
+    def __init__(self, site, log_path, N, barN, alpha_0, sigma, output_split_logs = False, batch_glr = True, use_cache = True, jobs = 1, nodelogs = None):
         assert site is not None
         assert isinstance(site, str)
         assert log_path is not None
         assert isinstance(log_path, str)
 
-        nodelogs = self._split_node_data(log_path, output_split_logs)
+        # the parsed log can be shared by several networks (see sweep.py)
+        if nodelogs is None:
+            nodelogs = senslab.logparser.parse(log_path, output_split_logs, use_cache)
 
         self._initialized = False
 
+        assert jobs >= 1
+        nodeids = sorted(nodelogs.keys())
+        if jobs > 1 and len(nodeids) > 1:
+            global _load_args
+            _load_args = (site, nodelogs, N, barN, alpha_0, sigma)
+            pool = multiprocessing.Pool(min(jobs, len(nodeids)))
+            try:
+                loaded = pool.map(_load_node, nodeids, chunksize = 1)
+            finally:
+                pool.terminate()
+                _load_args = None
+        else:
+            loaded = None
+
         nodes = {}
-        for nodeid, log in nodelogs.items():
+        for i, nodeid in enumerate(nodeids):
             print " * Loading data for node nr. %d ..." % nodeid
             assert not (nodeid in nodes.keys())
-        
-            node = Node(site, nodeid, log, N, barN, alpha_0, sigma)
+
+            if loaded is not None:
+                node, output = loaded[i]
+                sys.stdout.write(output)
+            else:
+                node = Node(site, nodeid, nodelogs[nodeid], N, barN, alpha_0, sigma)
 
             if node.initialized():
                 nodes[nodeid] = node
@@ -63,76 +112,113 @@ class Network(senslab.Network):
         self._alpha_0 = alpha_0
         self._sigma = sigma
         self._nodes = nodes
+        self._batch_glr = batch_glr
+
+        ids = sorted(nodes.keys())
+        self._adjacency = Adjacency(ids, [nodes[nodeid].get_position()[:2] for nodeid in ids])
 
         self._initialized = True
 
         print "ChangeDetection network initialized with N=%d, barN=%d, alpha0=%.3f, sigma=%.3f" % (N, barN, alpha_0, sigma)
         self.print_info()
+        self.print_sync_info()
 
     def initialized(self):
         return self._initialized
 
+    def print_sync_info(self):
+        assert self._initialized
+        #
+        # time from reset to the first size estimate, i.e. until the epoch-syncer
+        # switched to the `run-time` epoch timings
+        #
+        synced = [(node.get_synced_epoch(), node.get_synced_time()) for node in self._nodes.values() if node.get_synced_epoch() is not None]
+        if not len(synced):
+            print "warning: no sync info found"
+            return
+
+        epochs = set(x[0] for x in synced)
+        times = [x[1] for x in synced]
+        print "Nodes synced at epoch(s) %s, time to first estimate %.2f < %.2f < %.2f s" % (repr(sorted(epochs)), min(times), numpy.mean(times), max(times))
+        if len(epochs) > 1:
+            print "warning: nodes didn't agree on the synced epoch"
+
     def get_epoch(self):
         assert self._initialized
         return self._epoch
 
-    def step(self):
+    def step(self, build_graph = True):
+        """Move all nodes to the next epoch.
+
+        Return the Adjacency updated with the packets received in the epoch
+        (see adjacency.py), or None if build_graph is False.
+        """
         assert self._initialized
 	self._epoch += 1
 
+        due = []
         for node in self._nodes.values():
-            node.tick_epoch()
+            if node.tick_epoch(run_test = not self._batch_glr):
+                due.append(node)
             assert node.get_epoch() == self._epoch
 
+        if len(due):
+            self._batch_test(due)
+
+        if not build_graph:
+            return None
+
         #
-        # build the graph for this epoch
+        # update the adjacency with the packets received in this epoch
         #
-        if 0:
-            G = nx.Graph()
-        else:
-            G = nx.DiGraph()
-        unknown_sync_ids = []
-        unknown_data_ids = []
-        for nodeid, node in self._nodes.items():
-            G.add_node(nodeid)
-            pos = node.get_position()
-            
-            #G.node[nodeid]['pos'] = [pos[i] for i in (0,2)]
-            G.node[nodeid]['pos'] = [pos[i] for i in (0,1)]
-
-
-            for senderid in node.get_data_packets(self._epoch):
-                # Check that senderid is the node-id that we could load without errors
-                if senderid in self._nodes.keys():
-                    try:
-                        G[nodeid][senderid]['data_weight'] += 1
-                    except:
-                        G.add_edge(nodeid, senderid, data_weight = 1.)
-                else:
-                    if senderid not in unknown_data_ids:
-                        unknown_data_ids.append(senderid)
-
-            for senderid in node.get_sync_packets(self._epoch):
-                # Check that senderid is the node-id that we could load without errors
-                if senderid in self._nodes.keys():
-                    try:
-                        G[nodeid][senderid]['sync_weight'] += 1
-                    except:
-                        G.add_edge(nodeid, senderid, sync_weight = 1.)
-                else:
-                    if senderid not in unknown_sync_ids:
-                        unknown_sync_ids.append(senderid)
-
-        if len(unknown_sync_ids):
-            print "@%d unknown sync sources with board-id(s) %s" % (self._epoch, repr(unknown_sync_ids))
-
-        if len(unknown_data_ids):
-            print "@%d unknown data sources with board-id(s) %s" % (self._epoch, repr(unknown_data_ids))
-
-        #print "G.edge", G.edge
-        #print nx.get_edge_attributes(G, 'sync_weight')
-        #print nx.get_edge_attributes(G, 'data_weight')
-        return G
+        for kind in ('data', 'sync'):
+            receivers = []
+            senders = []
+            unknown_ids = []
+            for i, nodeid in enumerate(self._adjacency.ids()):
+                node = self._nodes[nodeid]
+                packets = node.get_data_packets(self._epoch) if kind == 'data' else node.get_sync_packets(self._epoch)
+                for senderid in packets:
+                    # Check that senderid is the node-id that we could load without errors
+                    j = self._adjacency.index(senderid)
+                    if j is not None:
+                        receivers.append(i)
+                        senders.append(j)
+                    elif senderid not in unknown_ids:
+                        unknown_ids.append(senderid)
+
+            self._adjacency.update(kind, receivers, senders)
+
+            if len(unknown_ids):
+                print "@%d unknown %s sources with board-id(s) %s" % (self._epoch, kind, repr(unknown_ids))
+
+        return self._adjacency
+
+
+    def _batch_test(self, nodes):
+        #
+        # run the change test of all nodes at once, the nodes with a different
+        # M (hence thresholds) are tested separately
+        #
+        groups = {}
+        for node in nodes:
+            groups.setdefault(node.get_M(), []).append(node)
+
+        for M, group in groups.items():
+            windows = [node.glr_window() for node in group]
+            x = numpy.array([w[0] for w in windows])
+            S = numpy.array([w[1] for w in windows])
+            M_log_x = numpy.array([w[2] for w in windows])
+
+            node = group[0]
+            info = glr.glr_test(x, S, M_log_x, M, node.get_N(), node.get_barN(), node.get_sigma(), node.get_log_lambdas())
+            for i, node in enumerate(group):
+                node.set_test_info(*[a[i] for a in info])
+
+
+    def get_adjacency(self):
+        assert self._initialized
+        return self._adjacency
 
 
     def get_M(self):
@@ -173,6 +259,6 @@ class Network(senslab.Network):
 
         return last_epoch
 
-    def draw_graph(self):
+    def draw_graph(self, jobs = 1, save_frames = False):
         assert self._initialized
-        grapher.draw_graph(self, self._log_path)
+        grapher.draw_graph(self, self._log_path, jobs, save_frames)
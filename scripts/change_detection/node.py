@@ -22,16 +22,30 @@
 
 
 import sys
-import re
 import numpy
 import senslab
+import glr
+import calibration
 from itertools import chain
+from collections import deque
 
 AGENT_STATE_STARTINGUP = 0
 AGENT_STATE_SS = 1
 AGENT_STATE_SLEEPING = 2
 
+# Contiki's kernel ticks per second
+CLOCK_SECOND = 128
+
 class Node(senslab.Node):
+    #
+    # Legacy thresholds, indexed by T-1
+    #
+    # ! they were computed for a pre-change window much longer than N+1-T:
+    #   with N=25 and barN=10 the (100, 0.001) entry raises false alarms at
+    #   the change time T with probability 0.13% (T=1) to 1.8% (T=16), 2.7%
+    #   per test. The Monte Carlo calibrations of the actual test in the
+    #   thresholds folder (see calibration.py) take precedence
+    #
     _log_lambdas_dict = {
       # M, alpha_0
       
@@ -43,14 +57,18 @@ class Node(senslab.Node):
       (50, 0.05) : (-1.2704, -2.0016, -2.5753, -3.0916, -3.5540, -3.9869, -4.4003, -4.8128, -5.2163, -5.6160, -5.9588, -6.3524, -6.7083, -7.0194, -7.3843, -7.7206, -8.1068, -8.4173, -8.7564, -9.0936, -9.4432, -9.7914, -10.0662, -10.4666, -10.7379, -11.0513, -11.3435, -11.6904, -12.0084, -12.3080, -12.6399, -12.9290, -13.2691, -13.5290, -13.8847, -14.1689, -14.4879, -14.7850, -15.1033, -15.3961, -15.6525, -15.9912, -16.2659, -16.5944, -16.8643)
       }
 
-    def __init__(self, site, nodeid, nodelog, N, barN, alpha_0, sigma):
+    # the thresholds of each (M, N, barN, sigma, alpha_0), see
+    # _get_log_lambdas()
+    _log_lambdas_found = {}
+
+    def __init__(self, site, nodeid, records, N, barN, alpha_0, sigma):
         assert isinstance(N, int) and N > 0
         assert isinstance(barN, int) and barN >= 1 and barN < N
         assert alpha_0 > 0. and alpha_0 < 1.
         assert sigma > 0. and sigma <= 1.
 
         # init our parent
-        senslab.Node.__init__(self, site, nodeid, nodelog)
+        senslab.Node.__init__(self, site, nodeid, records)
 
         if not self._initialized:
             #
@@ -65,187 +83,16 @@ class Node(senslab.Node):
             print "warning: unknown site %s" % site
             return
 
-        sync_packets_at_epoch = {}
-        data_packets_at_epoch = {}
-        logstats_at_epoch = {}
-        
-        M = None
-        D = None
-
-        i = 0
-        while i < len(nodelog):
-            line = nodelog[i]
-            #print line
-
-            #
-            # track sync packets
-            #
-            m = re.search(r'^@([0-9]+) track sync(.*)$', line)
-            if m is not None:
-                epoch = int(m.group(1))
-                ids = m.group(2).strip()
-                if not len(ids):
-                    nodelog.pop(i)
-                    continue
-
-                matched = True
-                ids = ids.split(' ')
-                for _id in ids:
-                    board_id16 = None
-                    count = None
-                    mm = re.search(r'^([0-9a-f]+):([0-9]+)', _id)
-                    if mm is None:
-                        matched = False
-                        break
-
-                    board_id16 = int(mm.group(1), 16)
-                    count = int(mm.group(2)) 
-
-                    senderid = senslab.siteinfo.get_nodeid_from_boardid(site, board_id16)
-                    if epoch not in sync_packets_at_epoch.keys():
-                        sync_packets_at_epoch[epoch] = [senderid]*count
-                    else:
-                        sync_packets_at_epoch[epoch].extend([senderid]*count)
-
-                if matched:
-                    nodelog.pop(i)
-                    continue
-
-            #
-            # track data packets
-            #
-            m = re.search(r'^@([0-9]+) track data(.*)$', line)
-            if m is not None:
-                epoch = int(m.group(1))
-                ids = m.group(2).strip()
-                if not len(ids):
-                    nodelog.pop(i)
-                    continue
-
-
-                matched = True
-                ids = ids.split(' ')
-                for _id in ids:
-                    mm = re.search(r'^([0-9a-f]+):([0-9]+)', _id)
-                    if mm is None:
-                        matched = False
-                        break
-                    board_id16 = int(mm.group(1), 16)
-                    count = int(mm.group(2)) 
-
-                    senderid = senslab.siteinfo.get_nodeid_from_boardid(site, board_id16)
-                    if epoch not in data_packets_at_epoch.keys():
-                        data_packets_at_epoch[epoch] = [senderid]*count
-                    else:
-                        data_packets_at_epoch[epoch].extend([senderid]*count)
-
-                if matched:
-                    nodelog.pop(i)
-                    continue
+        if records.error is not None:
+            print "warning: %s" % records.error
+            return
 
-
-            #
-            # find the sufficient statistics
-            #
-            m = re.search(r'^@([0-9]+) stats (.*)', line)
-            if m is not None:
-                if M is None or M <=0:
-                    #
-                    # we should have known M at this point
-                    # 
-                    break
-                epoch = int(m.group(1))
-                stats_str = m.group(2).split(' ')
-                logstats = []
-                estim = []
-                for x in stats_str:
-                    mm = re.search(r'^([0-9a-f]+).([0-9\-]+)', x)
-                    
-                    val = float(int(mm.group(1), 16))/float(0x100000000)
-                    exp = int(mm.group(2)) 
-                
-                    logstat = -(numpy.log(val) + exp*numpy.log(2))
-                    logstats.append(logstat)
-                    M = 100
-                    hatS = 1.
-                    if logstat != 0:
-                        hatS = float(M)/logstat
-
-                    estim.append(hatS)
-            
-                assert epoch not in logstats_at_epoch.keys()
-                logstats_at_epoch[epoch] = logstats
-                nodelog.pop(i)
-                continue
-
-
-            m = re.search(r'^@([0-9]+) size-estimator recv packet ids (.*)$', line)
-            if m is not None:
-                nodelog.pop(i)
-                continue
-
-            m = re.search(r'^@([0-9]+) data xfer crc mismatch$', line)
-            if m is not None:
-                nodelog.pop(i)
-                continue
-
-            m = re.search(r'^@([0-9]+) sync xfer crc mismatch$', line)
-            if m is not None:
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: data sent in "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: packet ids "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("epoch-syncer: sync offsets "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: waiting for epoch end"):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("epoch-syncer: epoch ") and line.endswith(' ended'):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("Starting 'epoch-syncer' 'size-estimator'"):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("epoch-syncer: adjusting "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: jumping epoch "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: M="):
-                m = re.search(r'size-estimator: M=([0-9]+), D=([0-9]+)', line)
-                if m is not None:
-                    M = int(m.group(1))
-                    D = int(m.group(2))
-
-                    nodelog.pop(i)
-                    continue
-
-            if line.startswith("epoch interval "):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("size-estimator: discard packet from epoch"):
-                print "warning: size-estimator lost epoch synchronism"
-                return
-
-            # go to the next line
-            print line
-            i += 1
+        M = records.M
+        D = records.D
+        synced_epoch = records.synced_epoch
+        synced_time = None
+        if records.synced_ticks is not None:
+            synced_time = float(records.synced_ticks)/CLOCK_SECOND
 
         if (M is None) or (M<=0):
             print "warning: M has non valid value %s" % (repr(M))
@@ -255,23 +102,34 @@ class Node(senslab.Node):
             print "warning: N has non valid value %s" % (repr(D))
             return
 
-        consensus_epochs = sorted(logstats_at_epoch.keys())
-        nr_consensus_epochs = len(consensus_epochs)
-        if not nr_consensus_epochs:
+        #
+        # the sufficient statistics, X = -log(value*2^(exp-32))
+        #
+        values = numpy.array(records.stats_value, dtype = float)/float(0x100000000)
+        exps = numpy.array(records.stats_exp, dtype = float)
+        logstats = -(numpy.log(values) + exps*numpy.log(2))
+        logstats_at_epoch = dict(zip(records.stats_epoch, logstats.reshape(-1, D).tolist()))
+
+        if not len(logstats_at_epoch):
             print "warning: no size-estimation statistics found"
 
-        if not (M, alpha_0) in self._log_lambdas_dict.keys():
-            print "warning: missing test thresholds for M=%d and alpha_0=%.f" % (M, alpha_0)
+        #
+        # the packets received from each sender, by node id
+        #
+        sync_packets_at_epoch = self._packets_at_epoch(site, records.sync_epoch, records.sync_board_id16, records.sync_count)
+        data_packets_at_epoch = self._packets_at_epoch(site, records.data_epoch, records.data_board_id16, records.data_count)
+
+        log_lambdas = self._get_log_lambdas(M, N, barN, sigma, alpha_0)
+        if log_lambdas is None:
             return
-            
+
         #
         # we are done parsing the log, init the change-detector
         #
-        self._log_lambdas = self._log_lambdas_dict[(M,alpha_0)]
-        assert len(self._log_lambdas) > N
+        self._log_lambdas = log_lambdas
+        assert len(self._log_lambdas) >= N - barN + 1
 
         self._M = M
-        self._M__1_minus_logM__ = M*(1. -numpy.log(M))
         self._D = D
         self._N = N
         self._barN = barN
@@ -280,14 +138,8 @@ class Node(senslab.Node):
 
         # init state
         self._size_estimates = None
-        self._traj = []
-        self._x_traj = []
-        self._M_log_x_traj = []
-        self._S_traj = []
-        for k in xrange(0,D):
-            self._x_traj.append([])
-            self._M_log_x_traj.append([])
-            self._S_traj.append([])
+        self._traj = deque(maxlen = N+1)
+        self._window = glr.GLRWindow(M, D, N)
 
         self._test_info = None
         
@@ -300,6 +152,8 @@ class Node(senslab.Node):
 
         self._state = AGENT_STATE_STARTINGUP
 
+        self._synced_epoch = synced_epoch
+        self._synced_time = synced_time
         self._sync_packets_at_epoch = sync_packets_at_epoch
         self._data_packets_at_epoch = data_packets_at_epoch
         self._logstats_at_epoch = logstats_at_epoch
@@ -311,6 +165,61 @@ class Node(senslab.Node):
 
 
 
+    @classmethod
+    def _get_log_lambdas(cls, M, N, barN, sigma, alpha_0):
+        #
+        # the thresholds are looked up once for each set of parameters: the
+        # nodes of a run share them and their source is printed only once
+        #
+        key = (M, N, barN, sigma, alpha_0)
+        if key not in cls._log_lambdas_found:
+            log_lambdas, source = cls._find_log_lambdas(M, N, barN, sigma, alpha_0)
+            if log_lambdas is None:
+                print "warning: missing test thresholds for M=%d and alpha_0=%g, see calibrate-thresholds.py" % (M, alpha_0)
+            elif source == 'interpolated':
+                print "warning: using test thresholds interpolated for M=%d and alpha_0=%g" % (M, alpha_0)
+            else:
+                print "Using the %s test thresholds for M=%d and alpha_0=%g" % (source, M, alpha_0)
+            cls._log_lambdas_found[key] = log_lambdas
+
+        return cls._log_lambdas_found[key]
+
+    @classmethod
+    def _find_log_lambdas(cls, M, N, barN, sigma, alpha_0):
+        #
+        # the thresholds calibrated for these parameters, the legacy ones in
+        # the table above, or those interpolated between two calibrated M
+        #
+        # ! the calibrations are the correct thresholds for this N and barN,
+        #   the legacy table is only a fallback (see above)
+        #
+        log_lambdas = calibration.load(M, N, barN, sigma, alpha_0)
+        if log_lambdas is not None and len(log_lambdas) >= N - barN + 1:
+            return (log_lambdas, 'calibrated')
+
+        if (M, alpha_0) in cls._log_lambdas_dict.keys() and len(cls._log_lambdas_dict[(M, alpha_0)]) > N:
+            return (cls._log_lambdas_dict[(M, alpha_0)], 'legacy')
+
+        log_lambdas = calibration.interpolate(M, N, barN, sigma, alpha_0)
+        if log_lambdas is not None and len(log_lambdas) >= N - barN + 1:
+            return (log_lambdas, 'interpolated')
+
+        return (None, None)
+
+
+    @staticmethod
+    def _packets_at_epoch(site, epochs, board_ids16, counts):
+        nodeids = {}
+        packets_at_epoch = {}
+        for epoch, board_id16, count in zip(epochs, board_ids16, counts):
+            if board_id16 not in nodeids:
+                nodeids[board_id16] = senslab.siteinfo.get_nodeid_from_boardid(site, board_id16)
+
+            packets_at_epoch.setdefault(epoch, []).extend([nodeids[board_id16]]*count)
+
+        return packets_at_epoch
+
+
     def _compute_X_S_at_end_of_epoch(self, t):
         assert t in self._logstats_at_epoch.keys()
 
@@ -319,9 +228,13 @@ class Node(senslab.Node):
         return (X,S)
 
 
-    def tick_epoch(self):
-        assert len(self._traj) <= self._N + 1
+    def tick_epoch(self, run_test = True):
+        """Move to the next epoch and run the change test.
 
+        Return True if the test is due but has not been run (run_test is
+        False): the caller must run it on glr_window() and pass the result to
+        set_test_info().
+        """
         self._epoch +=1
 
         if self._epoch not in self._logstats_at_epoch.keys():
@@ -330,7 +243,7 @@ class Node(senslab.Node):
             #
             if not self._state == AGENT_STATE_SLEEPING:
                 self._sleep()
-            return
+            return False
         
         if self._state == AGENT_STATE_SLEEPING:
             #
@@ -341,82 +254,35 @@ class Node(senslab.Node):
 
         self._test_info = None
 
-        assert len(self._x_traj) == self._D
-        assert len(self._M_log_x_traj) == self._D
-        assert len(self._S_traj) == self._D
-
         X, S = self._compute_X_S_at_end_of_epoch(self._epoch)
+
+        # track only X(t-N),...,X(t)
         self._traj.append((self._epoch, X, S))
+        self._window.push(X, S)
+
+        if not self._window.full():
+            assert self._state == AGENT_STATE_STARTINGUP
+            return False
+
+        if not self._state == AGENT_STATE_SS:
+            assert self._state == AGENT_STATE_STARTINGUP
+            self._state = AGENT_STATE_SS
+
+        if not run_test:
+            return True
+
+        # GLR test
+        x, S, M_log_x = self._window.get()
+        self.set_test_info(*glr.glr_test(x, S, M_log_x, self._M, self._N, self._barN, self._sigma, self._log_lambdas))
+        return False
+
+    def glr_window(self):
+        assert self._window.full()
+        return self._window.get()
 
-        for k in xrange(0,self._D):
-            self._x_traj[k].append(X[k])
-            self._M_log_x_traj[k].append(self._M*numpy.log(X[k]))
-            self._S_traj[k].append(S[k])
-
-        if len(self._traj) > self._N + 1:
-            assert len(self._traj) == self._N+2
-
-            # track only X(t-N),...,X(t)
-            self._traj.pop(0)
-            for k in xrange(0,self._D):
-                assert len(self._x_traj[k]) == self._N+2
-                assert len(self._M_log_x_traj[k]) == self._N+2
-                assert len(self._S_traj[k]) == self._N+2
-                self._x_traj[k].pop(0)
-                self._M_log_x_traj[k].pop(0)
-                self._S_traj[k].pop(0)
-        else:
-            if len(self._traj) < self._N + 1:
-                assert self._state == AGENT_STATE_STARTINGUP
-
-        if len(self._traj) == self._N+1:
-            if not self._state == AGENT_STATE_SS:
-                assert self._state == AGENT_STATE_STARTINGUP
-                self._state = AGENT_STATE_SS
-
-            # GLR test
-            change_time = []
-            pre_change_size = []
-            loglambda = []
-            alarm = []
-            
-            for k in xrange(0,self._D):
-                x_traj = numpy.array(self._x_traj[k], dtype = float)
-                M_log_x_traj = numpy.array(self._M_log_x_traj[k], dtype = float)
-                S_traj = numpy.array(self._S_traj[k], dtype = float)
-                x_traj_cumsum = numpy.cumsum(x_traj)
-                
-                # find the optimal change time
-                argminT = 1
-                minLogLambda = 0.
-                argminbarS = 0.
-                for T in xrange(self._N-self._barN + 1, 0, -1):
-                    barS = float(self._M*(self._N+1-T))/x_traj_cumsum[self._N-T]
-                    sigma_barS = self._sigma*barS
-
-                    M_log_sigma_barS_over_M_plus_1 = self._M*(numpy.log(sigma_barS)) + self._M__1_minus_logM__
-
-                    # compute the GLR using f_k(t-T+1),...,f_k(t)
-                    LogLambda = 0.
-                    for idx in xrange(self._N-T+1,self._N+1):
-                        if S_traj[idx] < sigma_barS:
-                            LogLambda +=  M_log_sigma_barS_over_M_plus_1 - sigma_barS*x_traj[idx] + M_log_x_traj[idx]
-
-                    if LogLambda <= minLogLambda:
-                        minLogLambda = LogLambda
-                        argminT = T
-                        argminbarS = barS
-
-                change_time.append(argminT)
-                pre_change_size.append(argminbarS)
-                loglambda.append(minLogLambda)
-
-                if minLogLambda < self._log_lambdas[argminT-1]:
-                    alarm.append(1)
-                else:
-                    alarm.append(0)
-
-            self._test_info = (change_time, pre_change_size, loglambda, alarm)
+    def set_test_info(self, change_time, pre_change_size, loglambda, alarm):
+        assert self._state == AGENT_STATE_SS
+        self._test_info = tuple(numpy.asarray(a).tolist() for a in (change_time, pre_change_size, loglambda, alarm))
          
     def traj(self):
         return self._traj
@@ -432,14 +298,8 @@ class Node(senslab.Node):
 
         self._state = AGENT_STATE_SLEEPING
         self._test_info = None
-        self._traj = []
-        self._x_traj = []
-        self._M_log_x_traj = []
-        self._S_traj = []
-        for k in xrange(0,self._D):
-            self._x_traj.append([])
-            self._M_log_x_traj.append([])
-            self._S_traj.append([])
+        self._traj.clear()
+        self._window.reset()
 
     def _wake(self):
         assert self._state == AGENT_STATE_SLEEPING
@@ -448,7 +308,7 @@ class Node(senslab.Node):
 
     def get_estimates_traj(self, k):
         assert isinstance(k, int) and k >= 1 and k <= self._D
-        return self._S_traj[k-1]
+        return self._window.S_traj(k-1)
     
     def test_info(self):
         return self._test_info
@@ -476,10 +336,22 @@ class Node(senslab.Node):
         assert self._initialized
         return self._sigma
 
+    def get_log_lambdas(self):
+        assert self._initialized
+        return self._log_lambdas
+
     def get_alpha0(self):
         assert self._initialized
         return self._alpha_0
 
+    def get_synced_epoch(self):
+        assert self._initialized
+        return self._synced_epoch
+
+    def get_synced_time(self):
+        assert self._initialized
+        return self._synced_time
+
     def get_data_packets(self, epoch):
         assert self._initialized
         if epoch in self._data_packets_at_epoch.keys():
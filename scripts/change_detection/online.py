@@ -0,0 +1,207 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Online change detection
+#
+# The `[nodeid] text` lines are read as they are written, from a pipe or from
+# a log file that is being appended to, and parsed one at a time with
+# senslab.logparser.parse_line(). As soon as the `@t stats` line of a node
+# arrives its GLR window is updated and the test run: the alarms are printed
+# (and flushed) right away.
+#
+# Memory stays bounded: the parsed columns of each node are consumed and
+# cleared after every line, each node keeps only the last N+1 epochs in its
+# GLR window.
+#
+# ! a node whose statistics skip an epoch starts over, as Node does when
+#   it wakes up
+#
+
+import os
+import sys
+import time
+import numpy
+import senslab
+import glr
+import node
+
+# seconds between two polls of a log file at its end
+ONLINE_POLL_INTERVAL = 0.1
+
+# alarms on the first ONLINE_SKIP_K neighborhoods are discarded (as in
+# grapher.draw_graph)
+ONLINE_SKIP_K = 1
+
+_COLUMNS = ('stats_epoch', 'stats_value', 'stats_exp',
+            'sync_epoch', 'sync_board_id16', 'sync_count',
+            'data_epoch', 'data_board_id16', 'data_count')
+
+
+class OnlineNode(object):
+    def __init__(self, nodeid, M, D, N, barN, sigma, log_lambdas):
+        self.nodeid = nodeid
+        self.M = M
+        self.D = D
+        self._N = N
+        self._barN = barN
+        self._sigma = sigma
+        self._log_lambdas = log_lambdas
+        self._window = glr.GLRWindow(M, D, N)
+        self._last_epoch = None
+
+    def push(self, epoch, values, exps):
+        """Push the statistics of epoch and run the test.
+
+        Return (change_time, pre_change_size, loglambda, alarm) or None while
+        the window is filling.
+        """
+        if self._last_epoch is not None and epoch != self._last_epoch + 1:
+            self._window.reset()
+        self._last_epoch = epoch
+
+        # the sufficient statistics, X = -log(value*2^(exp-32))
+        X = -(numpy.log(numpy.array(values, dtype = float)/float(0x100000000)) + numpy.array(exps, dtype = float)*numpy.log(2))
+        self._window.push(X, float(self.M)/X)
+        if not self._window.full():
+            return None
+
+        x, S, M_log_x = self._window.get()
+        info = glr.glr_test(x, S, M_log_x, self.M, self._N, self._barN, self._sigma, self._log_lambdas)
+        return tuple(numpy.asarray(a).tolist() for a in info)
+
+
+class OnlineDetector(object):
+    # the defaults are those of change-detection.py
+    def __init__(self, N = 25, barN = 10, alpha_0 = 0.001, sigma = 1.0):
+        self._N = N
+        self._barN = barN
+        self._alpha_0 = alpha_0
+        self._sigma = sigma
+
+        self._records = {}
+        self._nodes = {}
+        self._errors = {}
+        self.nr_tests = 0
+        self.nr_alarms = 0
+
+    def _node(self, rec):
+        n = self._nodes.get(rec.nodeid)
+        if n is not None and n.M == rec.M and n.D == rec.D:
+            return n
+
+        log_lambdas = node.Node._get_log_lambdas(rec.M, self._N, self._barN, self._sigma, self._alpha_0)
+        if log_lambdas is None:
+            self._error(rec, "missing test thresholds for M=%d and alpha_0=%g" % (rec.M, self._alpha_0))
+            return None
+
+        n = OnlineNode(rec.nodeid, rec.M, rec.D, self._N, self._barN, self._sigma, log_lambdas)
+        self._nodes[rec.nodeid] = n
+        return n
+
+    def _error(self, rec, error):
+        # warn once for each new error of a node
+        if self._errors.get(rec.nodeid) != error:
+            print "warning: node %d: %s" % (rec.nodeid, error)
+            self._errors[rec.nodeid] = error
+
+    def feed(self, l):
+        rec = senslab.logparser.parse_line(self._records, l, quiet = True)
+        if rec is None:
+            return
+
+        if rec.error is not None:
+            # start over, the node might recover
+            self._error(rec, rec.error)
+            rec.error = None
+            if rec.nodeid in self._nodes:
+                del self._nodes[rec.nodeid]
+
+        stats = zip(rec.stats_epoch, [(rec.stats_value[i*rec.D:(i+1)*rec.D], rec.stats_exp[i*rec.D:(i+1)*rec.D]) for i in xrange(len(rec.stats_epoch))])
+
+        # consume the parsed columns
+        for name in _COLUMNS:
+            del getattr(rec, name)[:]
+        rec._stats_epochs.clear()
+
+        for epoch, (values, exps) in stats:
+            n = self._node(rec)
+            if n is None:
+                continue
+
+            info = n.push(epoch, values, exps)
+            if info is None:
+                continue
+
+            self.nr_tests += 1
+            change_time, pre_change_size, loglambda, alarm = info
+            ks = [k + 1 for k in xrange(ONLINE_SKIP_K, len(alarm)) if alarm[k]]
+            if len(ks):
+                self.nr_alarms += 1
+                k = ks[0] - 1
+                print "@%d alarm node %d k %s change-time %d pre-change-size %.2f loglambda %.3f" % (epoch, rec.nodeid, ','.join(str(x) for x in ks), change_time[k], pre_change_size[k], loglambda[k])
+                sys.stdout.flush()
+
+
+def _lines(path, follow):
+    if path == '-':
+        f = sys.stdin
+    else:
+        f = open(path)
+
+    partial = ''
+    while True:
+        l = f.readline()
+        if not l:
+            if not follow:
+                break
+            time.sleep(ONLINE_POLL_INTERVAL)
+            continue
+
+        partial += l
+        if not partial.endswith('\n') and follow:
+            # the writer is in the middle of a line
+            continue
+
+        # ! without follow the last line can lack the newline
+        yield partial
+        partial = ''
+
+
+def run(path, N, barN, alpha_0, sigma, follow = None):
+    """Run the online change detection on the lines read from path (`-` for
+    stdin). Regular files are followed, as `tail -f` does, unless follow is
+    False.
+    """
+    if follow is None:
+        follow = path != '-' and os.path.isfile(path)
+
+    detector = OnlineDetector(N, barN, alpha_0, sigma)
+    try:
+        for l in _lines(path, follow):
+            detector.feed(l)
+    except KeyboardInterrupt:
+        pass
+
+    print "Online change detection: %d tests, %d alarms" % (detector.nr_tests, detector.nr_alarms)
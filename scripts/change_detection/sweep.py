@@ -0,0 +1,162 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Change-detector parameter sweep
+#
+# The experiment log is parsed once and the change-detection network is run,
+# without building graphs nor rendering, for every (N, barN, alpha_0, sigma)
+# tuple of a grid. The tuples are evaluated by a pool of worker processes that
+# share the parsed log (it is left in _sweep_args before the pool forks).
+#
+# ! the log is parsed once, so a tuple costs about a pass of
+#   Network.step(build_graph = False) over the experiment
+#
+# For every tuple the summary reports
+# - the number of tests run (one per node and epoch in the steady state)
+# - the number of tests with an alarm and the total number of alarms (over
+#   the D neighborhoods)
+# - the number of nodes that raised an alarm
+# - the mean detection delay: the change time estimated by the test that
+#   raised the first alarm of each node
+# - when the epoch of the change is known, the mean and max measured delay of
+#   the first alarm after it, and the number of alarms raised before it
+#
+
+import sys
+import itertools
+import multiprocessing
+from StringIO import StringIO
+import numpy
+import senslab
+import node
+from network import Network
+
+# alarms on the first SWEEP_SKIP_K neighborhoods are discarded (as in
+# grapher.draw_graph)
+SWEEP_SKIP_K = 1
+
+_sweep_args = None
+
+
+def _run(params):
+    site, log_path, nodelogs, change_epoch = _sweep_args
+    N, barN, alpha_0, sigma = params
+
+    stdout = sys.stdout
+    sys.stdout = StringIO()
+    try:
+        network = Network(site, log_path, N, barN, alpha_0, sigma, nodelogs = nodelogs)
+    finally:
+        sys.stdout = stdout
+
+    if not network.initialized():
+        return None
+
+    summary = {'tests' : 0, 'alarmed_tests' : 0, 'alarms' : 0, 'pre_change_alarms' : 0}
+    first_alarm = {}
+    first_alarm_after_change = {}
+
+    nodes = network.get_nodes()
+    for t in xrange(1, network.last_epoch() + 1):
+        network.step(build_graph = False)
+
+        for nodeid, agent in nodes.items():
+            if agent.state2() != node.AGENT_STATE_SS:
+                continue
+
+            change_time, pre_change_size, loglambda, alarm = agent.test_info()
+            nr_alarms = sum(alarm[SWEEP_SKIP_K:])
+            summary['tests'] += 1
+            if not nr_alarms:
+                continue
+
+            summary['alarmed_tests'] += 1
+            summary['alarms'] += nr_alarms
+
+            k = SWEEP_SKIP_K + alarm[SWEEP_SKIP_K:].index(1)
+            if nodeid not in first_alarm:
+                first_alarm[nodeid] = change_time[k]
+
+            if change_epoch is not None:
+                if t < change_epoch:
+                    summary['pre_change_alarms'] += nr_alarms
+                elif nodeid not in first_alarm_after_change:
+                    first_alarm_after_change[nodeid] = t - change_epoch
+
+    summary['alarmed_nodes'] = len(first_alarm)
+    summary['delay'] = numpy.mean(first_alarm.values()) if len(first_alarm) else None
+    if len(first_alarm_after_change):
+        summary['measured_delay'] = numpy.mean(first_alarm_after_change.values())
+        summary['max_measured_delay'] = max(first_alarm_after_change.values())
+    else:
+        summary['measured_delay'] = None
+        summary['max_measured_delay'] = None
+
+    return summary
+
+
+def sweep(site, log_path, Ns, barNs, alpha_0s, sigmas, change_epoch = None, jobs = 1, use_cache = True):
+    """Run the change detection for every tuple in the grid Ns x barNs x
+    alpha_0s x sigmas.
+
+    Return a list of ((N, barN, alpha_0, sigma), summary) in grid order, the
+    summary is None for the tuples the network could not be initialized with
+    (e.g. there are no test thresholds for alpha_0).
+    """
+    assert jobs >= 1
+    grid = [p for p in itertools.product(Ns, barNs, alpha_0s, sigmas) if p[1] < p[0]]
+    if not len(grid):
+        return []
+
+    global _sweep_args
+    _sweep_args = (site, log_path, senslab.logparser.parse(log_path, use_cache = use_cache), change_epoch)
+    try:
+        if jobs > 1 and len(grid) > 1:
+            pool = multiprocessing.Pool(min(jobs, len(grid)))
+            try:
+                summaries = pool.map(_run, grid, chunksize = 1)
+            finally:
+                pool.terminate()
+        else:
+            summaries = [_run(params) for params in grid]
+    finally:
+        _sweep_args = None
+
+    return zip(grid, summaries)
+
+
+def print_summary(results):
+    def _fmt(x, fmt):
+        return '-' if x is None else fmt % x
+
+    print "%4s %4s %7s %5s | %7s %7s %7s %6s %6s | %7s %7s %6s" % ('N', 'barN', 'alpha0', 'sigma', 'tests', 'alarmed', 'alarms', 'nodes', 'delay', 'm.delay', 'max', 'early')
+    for (N, barN, alpha_0, sigma), s in results:
+        row = "%4d %4d %7.3f %5.2f | " % (N, barN, alpha_0, sigma)
+        if s is None:
+            print row + "cannot initialize the network"
+            continue
+
+        print row + "%7d %7d %7d %6d %6s | %7s %7s %6d" % (s['tests'], s['alarmed_tests'], s['alarms'], s['alarmed_nodes'], _fmt(s['delay'], '%.2f'),
+                                                        _fmt(s['measured_delay'], '%.2f'), _fmt(s['max_measured_delay'], '%d'), s['pre_change_alarms'])
@@ -0,0 +1,225 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Check the vectorized GLR engine (change_detection/glr.py) against the
+# scalar loops it replaced in Node.tick_epoch()
+#
+# Random statistics are streamed epoch by epoch through a GLRWindow and
+# through the lists of the original code (append and pop(0)). At every epoch
+# the test is run by the original loops, by glr_test() on the window of each
+# node and by a single glr_test() on the windows of all nodes stacked, as
+# Network.step() does. The change times, pre-change sizes, log-GLRs and alarms
+# must be identical. The streams include size drops and quantized statistics
+# that make the log-GLRs of several change times tie.
+#
+# The script prints the mismatches and the cost of the three versions. The
+# exit status is non zero if a result differs
+#
+
+import sys
+import time
+import random
+
+import numpy
+
+import change_detection.glr as glr
+
+
+def _baseline_test(x_traj, M_log_x_traj, S_traj, M, N, barN, sigma, log_lambdas):
+    # the GLR test of Node.tick_epoch() before glr.py, one k at a time
+    M__1_minus_logM__ = M*(1. - numpy.log(M))
+
+    change_time = []
+    pre_change_size = []
+    loglambda = []
+    alarm = []
+
+    for k in xrange(0, len(x_traj)):
+        x_traj_k = numpy.array(x_traj[k], dtype = float)
+        M_log_x_traj_k = numpy.array(M_log_x_traj[k], dtype = float)
+        S_traj_k = numpy.array(S_traj[k], dtype = float)
+        x_traj_cumsum = numpy.cumsum(x_traj_k)
+
+        # find the optimal change time
+        argminT = 1
+        minLogLambda = 0.
+        argminbarS = 0.
+        for T in xrange(N - barN + 1, 0, -1):
+            barS = float(M*(N + 1 - T))/x_traj_cumsum[N - T]
+            sigma_barS = sigma*barS
+
+            M_log_sigma_barS_over_M_plus_1 = M*(numpy.log(sigma_barS)) + M__1_minus_logM__
+
+            # compute the GLR using f_k(t-T+1),...,f_k(t)
+            LogLambda = 0.
+            for idx in xrange(N - T + 1, N + 1):
+                if S_traj_k[idx] < sigma_barS:
+                    LogLambda += M_log_sigma_barS_over_M_plus_1 - sigma_barS*x_traj_k[idx] + M_log_x_traj_k[idx]
+
+            if LogLambda <= minLogLambda:
+                minLogLambda = LogLambda
+                argminT = T
+                argminbarS = barS
+
+        change_time.append(argminT)
+        pre_change_size.append(argminbarS)
+        loglambda.append(minLogLambda)
+        alarm.append(1 if minLogLambda < log_lambdas[argminT - 1] else 0)
+
+    return (change_time, pre_change_size, loglambda, alarm)
+
+
+class _Stream(object):
+    """The statistics X of the D k-steps neighborhoods of one node."""
+
+    def __init__(self, rnd, M, D, epochs, quantized):
+        self._rnd = rnd
+        self._M = M
+        self._D = D
+        self._quantized = quantized
+
+        size = rnd.choice((20, 50, 100, 200))
+        self._sizes = [size*(k + 1) for k in xrange(D)]
+        self._change_epoch = rnd.randint(0, epochs)
+        self._drop = rnd.choice((1., 0.8, 0.5, 0.2))
+
+    def X(self, t):
+        X = []
+        for k in xrange(self._D):
+            S = self._sizes[k]*(self._drop if t >= self._change_epoch else 1.)
+            x = self._rnd.gammavariate(self._M, 1./S)
+            if self._quantized:
+                # few distinct values: the log-GLRs of several T tie
+                x = round(x*S*4.)/(S*4.)
+            X.append(x)
+        return numpy.array(X)
+
+
+def check(M, D, N, barN, sigma, nodes, epochs, seed):
+    rnd = random.Random(seed)
+    log_lambdas = [-2. - 0.6*T for T in xrange(N)]
+
+    streams = [_Stream(rnd, M, D, epochs, quantized = (n % 4 == 3)) for n in xrange(nodes)]
+    windows = [glr.GLRWindow(M, D, N) for n in xrange(nodes)]
+    trajs = [([[] for k in xrange(D)], [[] for k in xrange(D)], [[] for k in xrange(D)]) for n in xrange(nodes)]
+
+    costs = [0., 0., 0.]
+    tests = 0
+    alarms = 0
+    ties = 0
+    mismatches = []
+    for t in xrange(epochs):
+        baseline = []
+        single = []
+        for n in xrange(nodes):
+            X = streams[n].X(t)
+            S = float(M)/X
+
+            # the lists of the original code
+            x_traj, M_log_x_traj, S_traj = trajs[n]
+            start = time.time()
+            for k in xrange(D):
+                x_traj[k].append(X[k])
+                M_log_x_traj[k].append(M*numpy.log(X[k]))
+                S_traj[k].append(S[k])
+                if len(x_traj[k]) > N + 1:
+                    x_traj[k].pop(0)
+                    M_log_x_traj[k].pop(0)
+                    S_traj[k].pop(0)
+            if len(x_traj[0]) == N + 1:
+                baseline.append(_baseline_test(x_traj, M_log_x_traj, S_traj, M, N, barN, sigma, log_lambdas))
+            costs[0] += time.time() - start
+
+            start = time.time()
+            windows[n].push(X, S)
+            if windows[n].full():
+                x, S_w, M_log_x = windows[n].get()
+                single.append(glr.glr_test(x, S_w, M_log_x, M, N, barN, sigma, log_lambdas))
+            costs[1] += time.time() - start
+
+        if not len(baseline):
+            continue
+
+        start = time.time()
+        stacked = [numpy.array(a) for a in zip(*[w.get() for w in windows])]
+        batch = glr.glr_test(stacked[0], stacked[1], stacked[2], M, N, barN, sigma, log_lambdas)
+        costs[2] += time.time() - start
+
+        # the tests whose minimum log-GLR is reached by more than one T
+        barS, LogLambda = glr.glr_log_lambdas(stacked[0], stacked[1], stacked[2], M, N, barN, sigma)
+        ties += ((LogLambda == LogLambda.min(axis = -1)[..., numpy.newaxis]).sum(axis = -1) > 1).sum()
+
+        for n in xrange(nodes):
+            ref = baseline[n]
+            for name, res in (('single', [a.tolist() for a in single[n]]), ('batch', [a[n].tolist() for a in batch])):
+                if list(res) != list(ref):
+                    mismatches.append((t, n, name, ref, res))
+
+        tests += nodes*D
+        alarms += sum(sum(r[3]) for r in baseline)
+
+    print "M=%d D=%d N=%d barN=%d sigma=%.2f: %d tests, %d alarms, %d tied change times, %d mismatches" % (M, D, N, barN, sigma, tests, alarms, ties, len(mismatches))
+    for t, n, name, ref, res in mismatches[:10]:
+        print "  epoch %d node %d (%s): reference %s, glr %s" % (t, n, name, ref, res)
+
+    tests_per_node = float(tests)/D
+    print "  cost per node and epoch: loops %.1f us, glr_test %.1f us, glr_test of %d nodes stacked %.1f us" % \
+        tuple([c*1e6/tests_per_node for c in costs[:2]] + [nodes, costs[2]*1e6/tests_per_node])
+
+    return len(mismatches)
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser()
+    parser.add_option("-n", "--nodes", type="int", dest="nodes", default=50,
+                      help="the number of simulated nodes (default: 50).", metavar="nodes")
+    parser.add_option("-e", "--epochs", type="int", dest="epochs", default=100,
+                      help="the number of epochs (default: 100).", metavar="epochs")
+    parser.add_option("--seed", type="int", dest="seed", default=0,
+                      help="the seed of the random generator (default: 0).", metavar="seed")
+
+    (options, args) = parser.parse_args()
+
+    if len(args):
+        print "error: cannot parse these arguments %s\n" % args
+        parser.print_help()
+        sys.exit(1)
+
+    # M, D, N, barN, sigma
+    setups = ((100, 7, 25, 10, 1.0), (50, 7, 25, 10, 1.0), (100, 3, 20, 5, 0.8), (100, 5, 45, 15, 0.5))
+
+    if options.nodes < 1 or options.epochs <= max(s[2] for s in setups):
+        print "error: choose at least one node and more than %d epochs." % max(s[2] for s in setups)
+        sys.exit(1)
+
+    failed = 0
+    for i, (M, D, N, barN, sigma) in enumerate(setups):
+        failed += check(M, D, N, barN, sigma, options.nodes, options.epochs, options.seed*len(setups) + i)
+
+    sys.exit(1 if failed else 0)
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+
+/*
+ * Host benchmark of senslab-app/net/connection-tracker.c
+ *
+ * The tracker is built with the CONNECTION_TRACKER_SIZE_BITS and
+ * CONNECTION_TRACKER_MAX_PROBES given on the command line (see the Makefile)
+ * and fed with the traffic of `neighbours` nodes: each epoch every neighbour
+ * sends one sync and DATA_PACKETS data packets in random order, then both
+ * types are printed (the output is discarded). `churn` percent of the
+ * neighbours are replaced by new nodes at each epoch, so the eviction path
+ * runs too.
+ *
+ * The time per tracked packet and the fraction of packets counted as
+ * overflow are reported.
+ *
+ *   usage: connection-tracker-bench neighbours [epochs] [churn] [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../senslab-app/net/connection-tracker.c"
+
+
+#define DATA_PACKETS 4
+
+
+struct packet {
+	int type;
+	uint16_t board_id16;
+};
+
+
+static double _now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static char _taken[1 << 16];
+
+static uint16_t _new_id(void) {
+	uint16_t id;
+
+	do {
+		id = (uint16_t)(rand() & 0xffff);
+	} while (_taken[id]);
+	_taken[id] = 1;
+	return id;
+}
+
+
+int main(int argc, char *argv[]) {
+	int neighbours, epochs, churn;
+	int i, e, nr_packets;
+	uint16_t *ids;
+	struct packet *packets;
+	unsigned long tracked, overflows;
+	double track_time, print_time, t;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s neighbours [epochs] [churn] [seed]\n", argv[0]);
+		return 1;
+	}
+	neighbours = atoi(argv[1]);
+	epochs = (argc > 2) ? atoi(argv[2]) : 1000;
+	churn = (argc > 3) ? atoi(argv[3]) : 10;
+	srand((argc > 4) ? atoi(argv[4]) : 1);
+
+	if ((neighbours < 1) || (neighbours > 0x8000) || (epochs < 1) || (churn < 0) || (churn > 100)) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	nr_packets = neighbours * (1 + DATA_PACKETS);
+	ids = malloc(neighbours * sizeof(uint16_t));
+	packets = malloc(nr_packets * sizeof(struct packet));
+	if ((ids == NULL) || (packets == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i=0; i < neighbours; i++)
+		ids[i] = _new_id();
+
+	tracked = 0;
+	overflows = 0;
+	track_time = 0.;
+	print_time = 0.;
+	for (e=0; e < epochs; e++) {
+		int type;
+
+		/*
+		 * replace `churn` percent of the neighbours with new nodes
+		 */
+		for (i=0; i < neighbours * churn / 100; i++) {
+			int k = rand() % neighbours;
+
+			_taken[ids[k]] = 0;
+			ids[k] = _new_id();
+		}
+
+		for (i=0; i < nr_packets; i++) {
+			packets[i].type = (i < neighbours) ? CONNECTION_TRACK_SYNC : CONNECTION_TRACK_DATA;
+			packets[i].board_id16 = ids[i % neighbours];
+		}
+		for (i=nr_packets - 1; i > 0; i--) {
+			int k = rand() % (i + 1);
+			struct packet tmp = packets[i];
+
+			packets[i] = packets[k];
+			packets[k] = tmp;
+		}
+
+		t = _now();
+		for (i=0; i < nr_packets; i++)
+			connection_track(packets[i].type, packets[i].board_id16, (uint16_t)e);
+		track_time += _now() - t;
+		tracked += nr_packets;
+
+		for (type=__CONNECTION_TRACK_FIRST; type <= __CONNECTION_TRACK_LAST; type++)
+			overflows += _tracker.overflows[type];
+
+		t = _now();
+		for (type=__CONNECTION_TRACK_FIRST; type <= __CONNECTION_TRACK_LAST; type++)
+			connection_print_and_zero(type, (uint16_t)e);
+		print_time += _now() - t;
+	}
+
+	printf("%4d slots, %4d probes, %4d neighbours: %7.1f ns/packet, %8.1f us/epoch print, overflow %lu/%lu (%.2f%%)\n",
+	       CONNECTION_TRACKER_MAX_NODES, CONNECTION_TRACKER_MAX_PROBES, neighbours,
+	       track_time * 1e9 / tracked, print_time * 1e6 / epochs,
+	       overflows, tracked, 100. * overflows / tracked);
+
+	free(ids);
+	free(packets);
+	return 0;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+#
+# Check the on-node size estimates of senslab-app/math/fractional48.c
+#
+# The C code is built on the host (`make fractional48-dump`) and fed with
+# random statistics. Its output must match the mirror in
+# scripts/math/fixpointops.py bit for bit; the size estimates are also
+# compared with the float computation M/-ln(stat) of the post-processing
+# scripts and the worst relative error is reported.
+#
+# The exit status is non zero on a mismatch
+#
+
+import os
+import sys
+import math
+import random
+import subprocess
+
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'math'))
+import fixpointops
+
+
+# the estimates outside this range are not compared with the float ones: the
+# Q8 quantization dominates below, the networks are never larger above
+ESTIMATE_RANGE = (1., 2048.)
+
+
+def _to_fractional48(ln_x):
+    # x = (value/2^31)*2^(exp-1) with value normalized in [2^31, 2^32)
+    e2 = ln_x/math.log(2)
+    exp = int(math.floor(e2)) + 1
+    value = int(2**(e2 - exp + 32))
+    return min(max(value, 0x80000000), 0xffffffff), exp
+
+
+def _statistics(count, seed):
+    rnd = random.Random(seed)
+    stats = []
+
+    # the edge cases
+    for M in (1, 100, 0xffff):
+        stats += [(0, 0, M), (0x80000000, 0, M), (0xffffffff, 0, M), (0x80000000, -32767, M), (0xffffffff, -1, M)]
+
+    # the statistics of the uniform estimator: the log of the product of the
+    # minima of M uniform samples from S nodes
+    for i in xrange(count/2):
+        M = rnd.choice((10, 50, 100, 200))
+        S = rnd.randint(1, 2048)
+        ln_x = sum(math.log(1. - rnd.random())/S for m in xrange(M))
+        if ln_x < 0.:
+            stats.append(_to_fractional48(ln_x) + (M,))
+
+    # any normalized fractional48
+    while len(stats) < count:
+        stats.append((rnd.randint(0x80000000, 0xffffffff), -rnd.randint(0, 400), rnd.randint(1, 0xffff)))
+
+    return stats
+
+
+def _mirror(value, exp, M):
+    if value == 0:
+        return 0, 0, 0
+
+    f48 = (value, exp)
+    return fixpointops.fractional48_neg_log2(f48), fixpointops.fractional48_ln(f48), fixpointops.fractional48_size_estimate(f48, M)
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser()
+    parser.add_option("-d", "--driver", dest="driver", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'fractional48-dump'),
+                      help="the host build of fractional48.c (default: ./fractional48-dump).", metavar="path")
+    parser.add_option("-n", "--count", type="int", dest="count", default=200000,
+                      help="the number of statistics to check (default: 200000).", metavar="count")
+    parser.add_option("--seed", type="int", dest="seed", default=0,
+                      help="the seed of the random generator (default: 0).", metavar="seed")
+
+    (options, args) = parser.parse_args()
+
+    if len(args):
+        print "error: cannot parse these arguments %s\n" % args
+        parser.print_help()
+        sys.exit(1)
+
+    if not os.path.exists(options.driver):
+        print "error: cannot find %s, build it with `make fractional48-dump`." % options.driver
+        sys.exit(1)
+
+    stats = _statistics(options.count, options.seed)
+
+    driver = subprocess.Popen([options.driver], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = driver.communicate(''.join('%d %d %d\n' % s for s in stats))[0].splitlines()
+    if driver.returncode != 0 or len(out) != len(stats):
+        print "error: %s failed after %d of %d statistics." % (options.driver, len(out), len(stats))
+        sys.exit(1)
+
+    mismatches = 0
+    worst = 0.
+    worst_stat = None
+    compared = 0
+    for stat, line in zip(stats, out):
+        got = tuple(int(v) for v in line.split())
+        ref = _mirror(*stat)
+        if got != ref:
+            if mismatches < 10:
+                print "mismatch 0x%.8x.%d M=%d: C %s, fixpointops %s" % (stat + (got, ref))
+            mismatches += 1
+            continue
+
+        value, exp, M = stat
+        if value == 0:
+            continue
+        ln_x = math.log(value/2.**31) + (exp - 1)*math.log(2)
+        if ln_x >= 0.:
+            continue
+
+        estim = -M/ln_x
+        if estim < ESTIMATE_RANGE[0] or estim > ESTIMATE_RANGE[1]:
+            continue
+
+        compared += 1
+        err = abs(fixpointops.size_estimate_to_float(got[2]) - estim)/estim
+        if err > worst:
+            worst = err
+            worst_stat = (stat, estim)
+
+    print "%d statistics, %d mismatches with fixpointops" % (len(stats), mismatches)
+    if worst_stat is not None:
+        print "%d estimates in [%g, %g], worst relative error %.3g (0x%.8x.%d M=%d, estimate %.3f)" % ((compared,) + ESTIMATE_RANGE + (worst,) + worst_stat[0] + (worst_stat[1],))
+
+    sys.exit(1 if mismatches else 0)
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+
+/*
+ * Host driver of senslab-app/math/fractional48.c
+ *
+ * Reads `value exp M` lines from stdin and writes
+ *
+ *   neg_log2 ln size_estimate
+ *
+ * as computed on node. fractional48-check.py compares them with the mirror
+ * in scripts/math/fixpointops.py
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fractional48.h"
+
+
+int main(void) {
+	unsigned long int value;
+	int exp;
+	unsigned int M;
+	fractional48_t f48;
+
+	while (scanf("%lu %d %u", &value, &exp, &M) == 3) {
+		f48.value = value;
+		f48.exp = exp;
+		printf("%lu %ld %lu\n",
+		       (unsigned long int)((value == 0) ? 0 : fractional48_neg_log2(&f48)),
+		       (long int)((value == 0) ? 0 : fractional48_ln(&f48)),
+		       (unsigned long int)fractional48_size_estimate(&f48, M));
+	}
+
+	return 0;
+}
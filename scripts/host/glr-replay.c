@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+
+/*
+ * Host driver of senslab-app/size-estimators/uniform/glr-detector.c
+ *
+ * Reads one line per epoch with the D sufficient statistics `value exp` and
+ * runs one detector for each k, as the uniform estimator does. The first
+ * output line holds the thresholds log(lambda_T) compiled in the detector,
+ * then each test is written as
+ *
+ *   epoch k T barS logGLR alarm ns [cycles]
+ *
+ * with Q16 values and the host time of glr_detector_push() (the cycles are
+ * read from the time stamp counter on x86). glr-replay.py compares the
+ * results with a float transcription of Node.tick_epoch().
+ *
+ *   usage: glr-replay D < statistics
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * ! before the senslab-app headers: util.h defines __always_inline__
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "../../senslab-app/size-estimators/uniform/glr-detector.c"
+
+
+static long int _now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000l + ts.tv_nsec;
+}
+
+
+int main(int argc, char *argv[]) {
+	struct glr_detector *detectors;
+	struct glr_detector_result res;
+	unsigned long int value;
+	int D, k, exp, epoch;
+
+	if ((argc < 2) || ((D = atoi(argv[1])) < 1)) {
+		fprintf(stderr, "usage: %s D < statistics\n", argv[0]);
+		return 1;
+	}
+
+	detectors = malloc(D*sizeof(struct glr_detector));
+	if (detectors == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (k=0; k < D; k++)
+		glr_detector_init(&detectors[k]);
+
+	printf("lambdas");
+	for (k=0; k < GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1; k++)
+		printf(" %ld", (long int)__log_lambdas[k]);
+	printf("\n");
+
+	for (epoch=0; ; epoch++) {
+		for (k=0; k < D; k++) {
+			fractional48_t stat;
+			long int ns;
+			char ret;
+#ifdef HAVE_TSC
+			unsigned long long int cycles;
+#endif
+
+			if (scanf("%lu %d", &value, &exp) != 2) {
+				free(detectors);
+				return 0;
+			}
+			stat.value = value;
+			stat.exp = exp;
+
+			ns = _now_ns();
+#ifdef HAVE_TSC
+			cycles = __rdtsc();
+#endif
+			ret = glr_detector_push(&detectors[k], &stat, &res);
+#ifdef HAVE_TSC
+			cycles = __rdtsc() - cycles;
+#endif
+			ns = _now_ns() - ns;
+
+			if (ret)
+				continue;
+
+			printf("%d %d %d %lu %ld %d %ld", epoch, k, res.change_time, (unsigned long int)res.pre_change_size,
+			       (long int)res.log_lambda, res.alarm, ns);
+#ifdef HAVE_TSC
+			printf(" %llu", cycles);
+#endif
+			printf("\n");
+		}
+	}
+}
@@ -0,0 +1,233 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+#
+# Replay synthetic statistics through the on-node GLR change detector
+#
+# The statistics of D k-steps neighborhoods are generated for a network whose
+# size drops at a given epoch. They are fed to the host build of
+# senslab-app/size-estimators/uniform/glr-detector.c (`make glr-replay`) and
+# to a float transcription of the test in Node.tick_epoch()
+# (scripts/change_detection/node.py) that uses the same thresholds.
+#
+# The script reports the tests whose alarm or change time differ, with the
+# log-GLRs of both change times so that near ties are visible, and the host
+# cost of both implementations. The exit status is non zero if an alarm
+# differs
+#
+
+import os
+import sys
+import math
+import time
+import random
+import subprocess
+
+
+# see glr-detector.h
+GLR_DETECTOR_M = 100
+GLR_DETECTOR_N = 25
+GLR_DETECTOR_BARN = 10
+GLR_DETECTOR_SIGMA = 1.0
+GLR_DETECTOR_FRAC_BITS = 16
+
+def _to_fractional48(ln_x):
+    # x = (value/2^31)*2^(exp-1) with value normalized in [2^31, 2^32)
+    e2 = ln_x/math.log(2)
+    exp = int(math.floor(e2)) + 1
+    value = int(2**(e2 - exp + 32))
+    return min(max(value, 0x80000000), 0xffffffff), exp
+
+
+def statistics(D, epochs, sizes, change_epoch, seed):
+    """Return, for each epoch, the D statistics as (value, exp) pairs."""
+    rnd = random.Random(seed)
+    stats = []
+    for t in xrange(epochs):
+        S = sizes[0] if t < change_epoch else sizes[1]
+        # the log of the product of the minima of M uniform samples from S nodes
+        stats.append([_to_fractional48(sum(math.log(1. - rnd.random())/S for m in xrange(GLR_DETECTOR_M)))
+                      for k in xrange(D)])
+    return stats
+
+
+class Reference(object):
+    """Float transcription of the test in Node.tick_epoch()."""
+
+    def __init__(self, log_lambdas):
+        self._log_lambdas = log_lambdas
+        self._x = []
+
+    def push(self, value, exp):
+        M, N, barN, sigma = GLR_DETECTOR_M, GLR_DETECTOR_N, GLR_DETECTOR_BARN, GLR_DETECTOR_SIGMA
+
+        self._x.append(-(math.log(value/2.**31) + (exp - 1)*math.log(2)))
+        if len(self._x) > N + 1:
+            self._x.pop(0)
+        if len(self._x) < N + 1:
+            return None
+
+        x = self._x
+        x_cumsum = [sum(x[:i + 1]) for i in xrange(N + 1)]
+        M__1_minus_logM__ = M*(1. - math.log(M))
+
+        min_log_lambda = 0.
+        argmin_T = 1
+        argmin_barS = 0.
+        log_lambdas = {}
+        for T in xrange(N - barN + 1, 0, -1):
+            barS = float(M*(N + 1 - T))/x_cumsum[N - T]
+            sigma_barS = sigma*barS
+            c = M*math.log(sigma_barS) + M__1_minus_logM__
+
+            log_lambda = 0.
+            for idx in xrange(N - T + 1, N + 1):
+                if M/x[idx] < sigma_barS:
+                    log_lambda += c - sigma_barS*x[idx] + M*math.log(x[idx])
+
+            log_lambdas[T] = log_lambda
+            if log_lambda <= min_log_lambda:
+                min_log_lambda = log_lambda
+                argmin_T = T
+                argmin_barS = barS
+
+        alarm = 1 if min_log_lambda < self._log_lambdas[argmin_T - 1] else 0
+        return argmin_T, argmin_barS, min_log_lambda, alarm, log_lambdas
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser()
+    parser.add_option("-d", "--driver", dest="driver", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'glr-replay'),
+                      help="the host build of glr-detector.c (default: ./glr-replay).", metavar="path")
+    parser.add_option("-D", type="int", dest="D", default=7,
+                      help="the number of k-steps neighborhoods (default: 7).", metavar="D")
+    parser.add_option("-e", "--epochs", type="int", dest="epochs", default=120,
+                      help="the number of epochs (default: 120).", metavar="epochs")
+    parser.add_option("-s", "--sizes", dest="sizes", default="100,40",
+                      help="the network size before and after the change (default: 100,40).", metavar="before,after")
+    parser.add_option("-c", "--change-epoch", type="int", dest="change_epoch", default=60,
+                      help="the epoch of the size change (default: 60).", metavar="epoch")
+    parser.add_option("--seed", type="int", dest="seed", default=3,
+                      help="the seed of the random generator (default: 3).", metavar="seed")
+
+    (options, args) = parser.parse_args()
+
+    if len(args):
+        print "error: cannot parse these arguments %s\n" % args
+        parser.print_help()
+        sys.exit(1)
+
+    try:
+        sizes = [int(s) for s in options.sizes.split(',')]
+        assert len(sizes) == 2 and min(sizes) > 0
+    except (ValueError, AssertionError):
+        print "error: cannot parse sizes \"%s\"." % options.sizes
+        sys.exit(1)
+
+    if options.D < 1 or options.epochs <= GLR_DETECTOR_N:
+        print "error: choose D >= 1 and more than %d epochs." % GLR_DETECTOR_N
+        sys.exit(1)
+
+    if not os.path.exists(options.driver):
+        print "error: cannot find %s, build it with `make glr-replay`." % options.driver
+        sys.exit(1)
+
+    stats = statistics(options.D, options.epochs, sizes, options.change_epoch, options.seed)
+
+    driver = subprocess.Popen([options.driver, str(options.D)], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = driver.communicate(''.join(' '.join('%d %d' % s for s in row) + '\n' for row in stats))[0].splitlines()
+    if driver.returncode != 0 or not len(out) or not out[0].startswith('lambdas '):
+        print "error: %s failed." % options.driver
+        sys.exit(1)
+
+    one = float(1 << GLR_DETECTOR_FRAC_BITS)
+    log_lambdas = [int(v)/one for v in out[0].split()[1:]]
+    tests = {}
+    for line in out[1:]:
+        f = line.split()
+        tests[(int(f[0]), int(f[1]))] = (int(f[2]), int(f[3])/one, int(f[4])/one, int(f[5]), int(f[6]), int(f[7]) if len(f) > 7 else None)
+
+    refs = [Reference(log_lambdas) for k in xrange(options.D)]
+    ref_time = 0.
+    alarm_mismatches = []
+    T_mismatches = []
+    alarms = [0, 0]
+    max_barS_err = 0.
+    max_log_lambda_err = 0.
+    compared = 0
+    for t, row in enumerate(stats):
+        for k, (value, exp) in enumerate(row):
+            start = time.time()
+            ref = refs[k].push(value, exp)
+            ref_time += time.time() - start
+            if ref is None:
+                continue
+
+            if (t, k) not in tests:
+                print "error: no result from %s for epoch %d, k %d." % (options.driver, t, k)
+                sys.exit(1)
+
+            T, barS, log_lambda, alarm = tests[(t, k)][:4]
+            ref_T, ref_barS, ref_log_lambda, ref_alarm, ref_log_lambdas = ref
+            compared += 1
+            alarms[0] += alarm
+            alarms[1] += ref_alarm
+
+            if alarm != ref_alarm:
+                alarm_mismatches.append((t, k, T, log_lambda, alarm, ref_T, ref_log_lambda, ref_alarm))
+            if T != ref_T:
+                T_mismatches.append((t, k, T, ref_T, ref_log_lambdas[T], ref_log_lambdas[ref_T]))
+                continue
+
+            max_barS_err = max(max_barS_err, abs(barS - ref_barS)/ref_barS)
+            max_log_lambda_err = max(max_log_lambda_err, abs(log_lambda - ref_log_lambda))
+
+    print "%d tests, %d alarms on node, %d alarms in the reference" % (compared, alarms[0], alarms[1])
+    print "%d alarm mismatches" % len(alarm_mismatches)
+    for m in alarm_mismatches:
+        print "  epoch %d k %d: node T=%d logGLR=%.4f alarm=%d, reference T=%d logGLR=%.4f alarm=%d" % m
+
+    print "on matching change times: max barS relative error %.3g, max logGLR error %.4f" % (max_barS_err, max_log_lambda_err)
+
+    # a change time mismatch is a near tie when the reference log-GLRs of the
+    # two change times are closer than the fixed-point error
+    print "%d change time mismatches" % len(T_mismatches)
+    for t, k, T, ref_T, ref_at_T, ref_at_ref_T in T_mismatches:
+        print "  epoch %d k %d: node T=%d, reference T=%d, reference logGLR %.4f at T=%d and %.4f at T=%d%s" % \
+            (t, k, T, ref_T, ref_at_T, T, ref_at_ref_T, ref_T, " (near tie)" if abs(ref_at_T - ref_at_ref_T) <= max_log_lambda_err else "")
+
+    ns = [r[4] for r in tests.values()]
+    cycles = [r[5] for r in tests.values() if r[5] is not None]
+    cost = "node code %.0f ns/test" % (float(sum(ns))/len(ns))
+    if len(cycles):
+        cost += " (%.0f cycles)" % (float(sum(cycles))/len(cycles))
+    print "host cost: %s, float reference %.0f ns/test" % (cost, ref_time*1e9/compared)
+
+    T_count = GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1
+    print "node cost per test and k: %d 64bit multiplications, %d divisions, %d logarithms, at most %d 32bit compares" % \
+        (4*T_count, T_count + 1, T_count, T_count*(T_count + 1)/2)
+
+    sys.exit(1 if len(alarm_mismatches) else 0)
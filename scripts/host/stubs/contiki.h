@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for Contiki's contiki.h
+ *
+ * The host programs in scripts/host only build the senslab-app sources that
+ * do not use the Contiki processes, timers or drivers
+ */
+#ifndef __HOST_CONTIKI_H__
+#define __HOST_CONTIKI_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#endif /* __HOST_CONTIKI_H__ */
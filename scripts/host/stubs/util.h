@@ -0,0 +1,22 @@
+/*
+ * Host stand-in for senslab-app/util.h
+ *
+ * The log output is discarded: the host programs look at the module state
+ * instead
+ */
+#ifndef __HOST_UTIL_H__
+#define __HOST_UTIL_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define __always_inline__ static inline __attribute__((always_inline))
+
+#define log_printf(...)   do {} while (0)
+#define log_line_begin()  do {} while (0)
+#define log_line_end()    do {} while (0)
+
+#define dbg(...)          do {} while (0)
+#define DBG_MATH          0
+
+#endif /* __HOST_UTIL_H__ */
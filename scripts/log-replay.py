@@ -0,0 +1,278 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Replay a recorded experiment log at a configurable speed, to load-test the
+# analysis pipeline without the testbed
+#
+# The lines are replayed in the order of the log, hence keeping the
+# interleaving of the nodes. Each line is timed after the last `@epoch` line of
+# its node: epoch e starts at e*EPOCH_INTERVAL (the epoch-syncer keeps the
+# nodes aligned to the epoch boundaries) and the lines of a node before its
+# first epoch line keep the time of the previous line.
+#
+# The lines can be written
+# - to stdout or to a fifo, as the `[nodeid] text` lines of the senslab serial
+#   aggregator
+# - to one pty per node, as the raw lines of the node serial port: the names
+#   of the pty slaves are written to the pty map file (`nodeid /dev/pts/N`
+#   lines) before the replay starts.
+#   ! like a serial port, a pty whose slave isn't read fills up: the lines
+#     that don't fit are dropped and counted
+#
+
+import os
+import sys
+import pty
+import tty
+import time
+import errno
+import fcntl
+import signal
+import struct
+import termios
+
+# the epoch interval in seconds (EPOCH_INTERVAL/CLOCK_SECOND in
+# senslab-app/proc-epoch-syncer.h)
+EPOCH_INTERVAL = 10.
+
+# seconds between two rate reports
+REPORT_INTERVAL = 5.
+
+# seconds to wait, at the end of the replay, for the consumers to read the
+# lines still queued in the ptys
+PTY_DRAIN_TIMEOUT = 5.
+
+
+def _split(l):
+    # [nodeid] text
+    end = l.find('] ')
+    if end < 2 or not l.startswith('[') or not l[1:end].isdigit():
+        return (None, None)
+    return (int(l[1:end]), l[end+2:])
+
+
+def _epoch(text):
+    if not text.startswith('@'):
+        return None
+    epoch, sep, rest = text[1:].partition(' ')
+    if not epoch.isdigit():
+        return None
+    return int(epoch)
+
+
+def _scan_nodes(log_path):
+    nodeids = set()
+    with open(log_path) as log:
+        for l in log:
+            nodeid, text = _split(l.rstrip('\n'))
+            if nodeid is not None:
+                nodeids.add(nodeid)
+    return sorted(nodeids)
+
+
+class AggregatorOutput(object):
+    def __init__(self, path):
+        if path is None:
+            self._f = sys.stdout
+        else:
+            if not os.path.exists(path):
+                os.mkfifo(path)
+            print >> sys.stderr, "Waiting for a reader on %s ..." % path
+            self._f = open(path, 'w')
+
+    def write(self, nodeid, text):
+        self._f.write('[%d] %s\n' % (nodeid, text))
+        return True
+
+    def flush(self):
+        self._f.flush()
+
+    def close(self):
+        if self._f is not sys.stdout:
+            self._f.close()
+
+
+class PtyOutput(object):
+    def __init__(self, nodeids, map_path):
+        self._masters = {}
+        self._slaves = []
+        with open(map_path, 'w') as f:
+            for nodeid in nodeids:
+                master, slave = pty.openpty()
+                # no echo nor newline translation, like a serial line
+                tty.setraw(slave)
+                # the slave is kept open: the master would read EIO until the
+                # consumer opens it
+                self._slaves.append(slave)
+                fcntl.fcntl(master, fcntl.F_SETFL, fcntl.fcntl(master, fcntl.F_GETFL) | os.O_NONBLOCK)
+                self._masters[nodeid] = master
+                f.write('%d %s\n' % (nodeid, os.ttyname(slave)))
+        print >> sys.stderr, "Opened %d ptys, see %s" % (len(nodeids), map_path)
+
+    def write(self, nodeid, text):
+        master = self._masters.get(nodeid)
+        if master is None:
+            return False
+
+        data = text + '\n'
+        try:
+            n = os.write(master, data)
+        except OSError as e:
+            if e.errno == errno.EAGAIN:
+                return False
+            raise
+        # ! a partial write leaves a truncated line, as on a serial overrun
+        return n == len(data)
+
+    def flush(self):
+        pass
+
+    def _queued(self):
+        queued = 0
+        for slave in self._slaves:
+            queued += struct.unpack('i', fcntl.ioctl(slave, termios.FIONREAD, '\0\0\0\0'))[0]
+        return queued
+
+    def close(self):
+        # ! closing the master discards the lines not yet read from the slave
+        deadline = time.time() + PTY_DRAIN_TIMEOUT
+        while self._queued() and time.time() < deadline:
+            time.sleep(0.05)
+
+        for fd in self._masters.values() + self._slaves:
+            os.close(fd)
+
+
+def replay(log_path, output, speed, epoch_interval, loop = False):
+    stop = [False]
+    def handler_sig_int(signum, frame):
+        stop[0] = True
+    signal.signal(signal.SIGINT, handler_sig_int)
+
+    nr_lines = 0
+    nr_dropped = 0
+    start = time.time()
+    last_report = start
+    last_report_lines = 0
+
+    while not stop[0]:
+        node_time = {}
+        log_time = None
+        log_start = None
+        replay_start = time.time()
+
+        with open(log_path) as log:
+            for l in log:
+                if stop[0]:
+                    break
+
+                nodeid, text = _split(l.rstrip('\n'))
+                if nodeid is None:
+                    continue
+
+                epoch = _epoch(text)
+                if epoch is not None:
+                    node_time[nodeid] = epoch*epoch_interval
+
+                t = node_time.get(nodeid, log_time)
+                if t is None:
+                    t = 0.
+                if log_start is None:
+                    log_start = t
+                # keep the log order: the replay time never goes back
+                log_time = t if log_time is None else max(log_time, t)
+
+                if speed > 0.:
+                    delay = replay_start + (log_time - log_start)/speed - time.time()
+                    if delay > 0.:
+                        output.flush()
+                        time.sleep(delay)
+
+                if output.write(nodeid, text):
+                    nr_lines += 1
+                else:
+                    nr_dropped += 1
+
+                now = time.time()
+                if now - last_report >= REPORT_INTERVAL:
+                    print >> sys.stderr, "replay: log time %.0f s, %.0f lines/s, %d lines, %d dropped" % (log_time, (nr_lines - last_report_lines)/(now - last_report), nr_lines, nr_dropped)
+                    last_report = now
+                    last_report_lines = nr_lines
+
+        output.flush()
+        if not loop:
+            break
+
+    elapsed = time.time() - start
+    print >> sys.stderr, "replay: %d lines in %.1f s (%.0f lines/s), %d dropped" % (nr_lines, elapsed, nr_lines/max(elapsed, 1e-3), nr_dropped)
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser(usage="usage: %prog [options] experiment.log")
+    parser.add_option("-x", "--speed", type="float", dest="speed", default=1.,
+                      help="replay `speed` times faster than real time, 0 replays as fast as possible (default: 1).", metavar="speed")
+    parser.add_option("-e", "--epoch-interval", type="float", dest="epoch_interval", default=EPOCH_INTERVAL,
+                      help="the epoch interval of the experiment in seconds (default: %g)." % EPOCH_INTERVAL, metavar="seconds")
+    parser.add_option("-o", "--output", dest="output",
+                      help="write the aggregated lines to the fifo (created if missing) or file at `path` instead of stdout.", metavar="path")
+    parser.add_option("-p", "--pty-map", dest="pty_map",
+                      help="write the lines of each node to its own pty and the pty names to `path`.", metavar="path")
+    parser.add_option("-l", "--loop", action="store_true", dest="loop", default=False,
+                      help="replay the log again when done, until interrupted.")
+
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        print "error: no experiment log given.\n"
+        parser.print_help()
+        sys.exit(0)
+
+    log_path = args[0]
+    if not os.path.isfile(log_path):
+        print "error: cannot find %s." % log_path
+        sys.exit(0)
+
+    if options.speed < 0. or options.epoch_interval <= 0.:
+        print "error: the speed and the epoch interval must be positive."
+        sys.exit(0)
+
+    if options.output and options.pty_map:
+        print "error: choose either --output or --pty-map."
+        sys.exit(0)
+
+    if options.pty_map:
+        output = PtyOutput(_scan_nodes(log_path), options.pty_map)
+    else:
+        output = AggregatorOutput(options.output)
+
+    try:
+        replay(log_path, output, options.speed, options.epoch_interval, options.loop)
+    except IOError as e:
+        if e.errno != errno.EPIPE:
+            raise
+    finally:
+        output.close()
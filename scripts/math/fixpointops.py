@@ -21,6 +21,9 @@
 #    distribution.
 
 
+import math
+from numbers import Number
+
 FIXPOINT32_MAX = 0xffffffff
 
 def fractional16_max(f1, f2):
@@ -144,3 +147,80 @@ def fractional48_mul(f48, f16):
 
     assert val <= FIXPOINT32_MAX
     return (val, exp)
+
+
+#
+# Fixed-point logarithms, mirror of senslab-app/math/fractional48.c
+#
+# log2 of the fractional48 mantissa is interpolated linearly in a table of
+# 2^LOG2_TABLE_BITS+1 entries with LOG2_FRAC_BITS fractional bits. The C
+# table is generated from log2_table() by gen-log2-table.py
+#
+LOG2_TABLE_BITS = 6
+LOG2_FRAC_BITS = 16
+
+# size estimates have SIZE_ESTIMATE_FRAC_BITS fractional bits
+SIZE_ESTIMATE_FRAC_BITS = 8
+
+
+def log2_table(bits=LOG2_TABLE_BITS, frac_bits=LOG2_FRAC_BITS):
+    n = 1 << bits
+    return [int(round(math.log(1. + float(i)/n, 2)*(1 << frac_bits))) for i in xrange(n + 1)]
+
+
+_log2_table = log2_table()
+
+# ln(2) and 1/ln(2) with LOG2_FRAC_BITS fractional bits
+LN2 = int(round(math.log(2)*(1 << LOG2_FRAC_BITS)))
+INV_LN2 = int(round((1 << LOG2_FRAC_BITS)/math.log(2)))
+
+
+def _log2_mantissa(val):
+    assert val > 0
+    assert val <= FIXPOINT32_MAX
+    assert val & 0x80000000
+
+    # the mantissa val/2^31 is in [1,2)
+    index = (val >> (31 - LOG2_TABLE_BITS)) & ((1 << LOG2_TABLE_BITS) - 1)
+    frac = (val >> (31 - LOG2_TABLE_BITS - 16)) & 0xffff
+    lo = _log2_table[index]
+    hi = _log2_table[index + 1]
+    return lo + (((hi - lo)*frac) >> 16)
+
+
+def fractional48_neg_log2(f48):
+    assert len(f48) == 2
+    val = f48[0]
+    exp = f48[1]
+    assert exp <= 0
+
+    # f48 = (val/2^31)*2^(exp-1)
+    return ((1 - exp) << LOG2_FRAC_BITS) - _log2_mantissa(val)
+
+
+def fractional48_ln(f48):
+    assert len(f48) == 2
+    val = f48[0]
+    exp = f48[1]
+
+    log2 = ((exp - 1) << LOG2_FRAC_BITS) + _log2_mantissa(val)
+    return (log2*LN2) >> LOG2_FRAC_BITS
+
+
+def fractional48_size_estimate(f48, M):
+    """Return M/-ln(f48) with SIZE_ESTIMATE_FRAC_BITS fractional bits."""
+    assert isinstance(M, int) and M > 0
+
+    if f48[0] == 0:
+        return 0
+
+    neg_log2 = fractional48_neg_log2(f48)
+    if neg_log2 == 0:
+        return 1 << SIZE_ESTIMATE_FRAC_BITS
+
+    estim = ((M*INV_LN2) << SIZE_ESTIMATE_FRAC_BITS)/neg_log2
+    return min(estim, 0xffffffff)
+
+
+def size_estimate_to_float(estim):
+    return float(estim)/(1 << SIZE_ESTIMATE_FRAC_BITS)
@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+#
+# Generate the log2 table used by senslab-app/math/fractional48.c
+#
+# The table is written to stdout, senslab-app/Makefile regenerates it at
+# build time as math/log2-table.h
+#
+
+import sys
+import math
+import fixpointops
+
+
+def _max_error(table):
+    # worst error of the interpolated log2 of the mantissa over a dense grid
+    worst = 0.
+    steps = 1 << 16
+    for i in xrange(steps):
+        val = 0x80000000 | (i << 15)
+        approx = ((1 << fixpointops.LOG2_FRAC_BITS) - fixpointops.fractional48_neg_log2((val, 0)))
+        exact = math.log(float(val)/0x80000000, 2)
+        worst = max(worst, abs(float(approx)/(1 << fixpointops.LOG2_FRAC_BITS) - exact))
+    return worst
+
+
+def main():
+    table = fixpointops.log2_table()
+
+    out = sys.stdout
+    out.write("/*\n")
+    out.write(" * Generated by scripts/math/gen-log2-table.py, do not edit\n")
+    out.write(" *\n")
+    out.write(" * log2(1 + i/2^LOG2_TABLE_BITS) with LOG2_TABLE_FRAC_BITS fractional bits,\n")
+    out.write(" * max interpolation error %.2e\n" % _max_error(table))
+    out.write(" */\n\n")
+    out.write("#ifndef __LOG2_TABLE_H__\n")
+    out.write("#define __LOG2_TABLE_H__\n\n")
+    out.write("#define LOG2_TABLE_BITS       %d\n" % fixpointops.LOG2_TABLE_BITS)
+    out.write("#define LOG2_TABLE_FRAC_BITS  %d\n" % fixpointops.LOG2_FRAC_BITS)
+    out.write("#define LOG2_TABLE_LN2        %dul\n" % fixpointops.LN2)
+    out.write("#define LOG2_TABLE_INV_LN2    %dul\n\n" % fixpointops.INV_LN2)
+    out.write("static const uint32_t __log2_table[%d] = {\n" % len(table))
+    for i in xrange(0, len(table), 8):
+        out.write("\t%s,\n" % ", ".join("0x%.5x" % v for v in table[i:i+8]))
+    out.write("};\n\n")
+    out.write("#endif /* __LOG2_TABLE_H__ */\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -22,5 +22,6 @@
 
 
 import siteinfo
+import logparser
 from network import Network
 from node import Node
@@ -0,0 +1,148 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+#
+# Decoder for the binary log records written by senslab-app/binlog.c
+#
+# Each record is decoded into the same text lines the node would have
+# printed without LOG_BINARY: the log parsers don't need to know about the
+# binary format.
+#
+
+import struct
+
+SENTINEL = 0x7e
+ESCAPE = 0x7d
+
+REC_STATS = 0x01
+REC_TRACK_SYNC = 0x02
+REC_TRACK_DATA = 0x03
+REC_TRACK_OVERFLOW = 0x04
+REC_ESTIMATES = 0x05
+
+# connection-tracker.h
+_TRACK_TYPES = {0 : 'sync', 1 : 'data'}
+
+
+def is_record(text):
+    return len(text) > 0 and ord(text[0]) == SENTINEL
+
+
+def crc16(data):
+    # the crc16 of Contiki's lib/crc16.c
+    acc = 0
+    for b in data:
+        acc ^= b
+        acc = ((acc >> 8) | (acc << 8)) & 0xffff
+        acc ^= (acc & 0xff00) << 4
+        acc &= 0xffff
+        acc ^= (acc >> 8) >> 4
+        acc ^= (acc & 0xff00) >> 5
+    return acc
+
+
+def _unescape(text):
+    data = []
+    escaped = False
+    for c in text:
+        b = ord(c)
+        if escaped:
+            data.append(b ^ 0x20)
+            escaped = False
+        elif b == ESCAPE:
+            escaped = True
+        else:
+            data.append(b)
+
+    if escaped:
+        return None
+    return data
+
+
+def decode(text):
+    """Decode a binary record into a list of text log lines.
+
+    Return None if the record is corrupted.
+    """
+    assert is_record(text)
+
+    data = _unescape(text[1:])
+    if data is None or len(data) < 4:
+        return None
+
+    payload, crc = data[:-2], data[-2] | (data[-1] << 8)
+    if crc16(payload) != crc:
+        return None
+
+    rectype = payload[0]
+    epoch = 0
+    shift = 0
+    i = 1
+    while True:
+        if i >= len(payload) or shift > 14:
+            return None
+        epoch |= (payload[i] & 0x7f) << shift
+        shift += 7
+        i += 1
+        if not (payload[i-1] & 0x80):
+            break
+
+    raw = ''.join(chr(b) for b in payload[i:])
+
+    if rectype == REC_STATS:
+        if len(raw) % 6:
+            return None
+        fields = []
+        for j in xrange(0, len(raw), 6):
+            value, exp = struct.unpack('<Ih', raw[j:j+6])
+            fields.append(' %.8x.%d' % (value, exp))
+        return ['@%d stats%s' % (epoch, ''.join(fields))]
+
+    if rectype in (REC_TRACK_SYNC, REC_TRACK_DATA):
+        if len(raw) % 3:
+            return None
+        fields = []
+        for j in xrange(0, len(raw), 3):
+            board_id16, count = struct.unpack('<HB', raw[j:j+3])
+            fields.append(' %.4x:%d' % (board_id16, count))
+        name = 'sync' if rectype == REC_TRACK_SYNC else 'data'
+        return ['@%d track %s%s' % (epoch, name, ''.join(fields))]
+
+    if rectype == REC_TRACK_OVERFLOW:
+        if len(raw) != 3:
+            return None
+        track_type, count = struct.unpack('<BH', raw)
+        if track_type not in _TRACK_TYPES.keys():
+            return None
+        return ['@%d track overflow %s %d' % (epoch, _TRACK_TYPES[track_type], count)]
+
+    if rectype == REC_ESTIMATES:
+        if len(raw) % 4:
+            return None
+        fields = []
+        for j in xrange(0, len(raw), 4):
+            estim, = struct.unpack('<I', raw[j:j+4])
+            fields.append(' %d.%.2d' % (estim >> 8, ((estim & 0xff)*100) >> 8))
+        return ['@%d estim%s' % (epoch, ''.join(fields))]
+
+    return None
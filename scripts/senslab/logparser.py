@@ -0,0 +1,540 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+#
+# Single-pass streaming parser of the experiment logs
+#
+# The log is read line by line and every `[nodeid] text` line is dispatched on
+# its first word (on the word after the epoch for the `@epoch kind ...` lines)
+# to a handler that stores the parsed values in the NodeRecords of the node.
+# The statistics and the connection tracks are kept in columnar arrays: the
+# memory used grows with the parsed data, not with the log size.
+#
+# The lines that no handler recognizes are printed (unless parsing quietly,
+# see parse_line()).
+#
+# The parsed records are cached next to the log (see `Parsed log cache` below)
+# and later parses of the same log load them from there.
+#
+
+import os
+import sys
+import json
+import shutil
+import hashlib
+from array import array
+import binlog
+
+# ! bump this whenever the handlers change what they store: it invalidates the
+#   parsed log caches
+PARSER_VERSION = 1
+
+
+class NodeRecords(object):
+    def __init__(self, nodeid):
+        self.nodeid = nodeid
+        self.nr_lines = 0
+
+        self.board_id64 = None
+        self.xfer_crc = None
+        self.M = None
+        self.D = None
+        self.synced_epoch = None
+        self.synced_ticks = None
+
+        # why the log can't be used, the rest of it is skipped
+        self.error = None
+
+        # sufficient statistics, D (value, exp) pairs per epoch
+        self.stats_epoch = array('i')
+        self.stats_value = array('I')
+        self.stats_exp = array('i')
+
+        # connection tracks, one (epoch, board-id16, count) entry per sender
+        self.sync_epoch = array('i')
+        self.sync_board_id16 = array('H')
+        self.sync_count = array('H')
+        self.data_epoch = array('i')
+        self.data_board_id16 = array('H')
+        self.data_count = array('H')
+
+        # only used while parsing, empty when loaded from the cache
+        self._stats_epochs = set()
+
+
+#
+# Handlers of the lines without epoch
+#
+def _board_id64(rec, epoch, args, text):
+    if rec.board_id64 is None:
+        try:
+            rec.board_id64 = int(args, 16)
+        except ValueError:
+            pass
+    return True
+
+
+def _xfer(rec, epoch, args, text):
+    if not args.startswith('crc') or not args[3:].isdigit():
+        return False
+    rec.xfer_crc = int(args[3:])
+    return True
+
+
+def _mac(rec, epoch, args, text):
+    return "Contiki 2.5 started" in text
+
+
+def _rime(rec, epoch, args, text):
+    return args.startswith("started with address")
+
+
+def _starting(rec, epoch, args, text):
+    return args.startswith("'epoch-syncer' 'size-estimator'")
+
+
+def _epoch_interval(rec, epoch, args, text):
+    return args.startswith("interval ")
+
+
+def _logbuf(rec, epoch, args, text):
+    if not args.startswith("dropped "):
+        return False
+    print "warning: node %d dropped log records (%s)" % (rec.nodeid, text)
+    return True
+
+
+_EPOCH_SYNCER_SKIP = ("sync offsets ", "skew ", "adjusting ")
+
+def _epoch_syncer(rec, epoch, args, text):
+    if args.startswith("synced at epoch "):
+        # synced at epoch <epoch> after <ticks> ticks
+        fields = args.split(' ')
+        if len(fields) != 7 or not fields[3].isdigit() or not fields[5].isdigit():
+            return False
+        rec.synced_epoch = int(fields[3])
+        rec.synced_ticks = int(fields[5])
+        return True
+
+    if args.startswith("epoch ") and args.endswith(" ended"):
+        return True
+
+    return args.startswith(_EPOCH_SYNCER_SKIP)
+
+
+_SIZE_ESTIMATOR_SKIP = ("data sent in ", "packet ids ", "waiting for epoch end", "jumping epoch ")
+
+def _size_estimator(rec, epoch, args, text):
+    if args.startswith("M="):
+        # M=<M>, D=<D>
+        fields = args.split(', ')
+        if len(fields) != 2 or not fields[1].startswith("D="):
+            return False
+        try:
+            rec.M = int(fields[0][2:])
+            rec.D = int(fields[1][2:])
+        except ValueError:
+            return False
+        return True
+
+    if args.startswith("discard packet from epoch"):
+        rec.error = "size-estimator lost epoch synchronism"
+        return True
+
+    return args.startswith(_SIZE_ESTIMATOR_SKIP)
+
+
+#
+# Handlers of the `@epoch kind ...` lines
+#
+def _skip(rec, epoch, args, text):
+    return True
+
+
+def _stats(rec, epoch, args, text):
+    if rec.M is None or rec.M <= 0:
+        # we should have known M at this point
+        rec.error = "M has non valid value %s" % (repr(rec.M))
+        return True
+
+    fields = args.split(' ')
+    if len(fields) != rec.D:
+        return False
+
+    values = []
+    exps = []
+    for x in fields:
+        # <value hex>.<exp>
+        value, sep, exp = x.partition('.')
+        try:
+            values.append(int(value, 16))
+            exps.append(int(exp))
+        except ValueError:
+            return False
+
+    if epoch in rec._stats_epochs:
+        rec.error = "duplicate statistics at epoch %d" % epoch
+        return True
+
+    rec._stats_epochs.add(epoch)
+    rec.stats_epoch.append(epoch)
+    rec.stats_value.extend(values)
+    rec.stats_exp.extend(exps)
+    return True
+
+
+def _track(rec, epoch, args, text):
+    name, sep, ids = args.partition(' ')
+    if name == 'overflow':
+        fields = ids.split(' ')
+        if len(fields) != 2 or fields[0] not in ('sync', 'data') or not fields[1].isdigit():
+            return False
+        print "warning: node %d connection tracker overflow at epoch %d (%s packets %s)" % (rec.nodeid, epoch, fields[0], fields[1])
+        return True
+
+    if name == 'sync':
+        columns = (rec.sync_epoch, rec.sync_board_id16, rec.sync_count)
+    elif name == 'data':
+        columns = (rec.data_epoch, rec.data_board_id16, rec.data_count)
+    else:
+        return False
+
+    entries = []
+    for _id in ids.split():
+        # <board-id16 hex>:<count>
+        board_id16, sep, count = _id.partition(':')
+        try:
+            entries.append((int(board_id16, 16), int(count)))
+        except ValueError:
+            return False
+
+    for board_id16, count in entries:
+        columns[0].append(epoch)
+        columns[1].append(board_id16)
+        columns[2].append(count)
+    return True
+
+
+def _size_estimator_at_epoch(rec, epoch, args, text):
+    return args.startswith("recv packet ids ")
+
+
+_XFER_SKIP = ("xfer crc mismatch", "xfer corruption, datalen ")
+
+def _xfer_error(rec, epoch, args, text):
+    return args.startswith(_XFER_SKIP)
+
+
+def _epoch_syncer_sync(rec, epoch, args, text):
+    # a sync packet stamped at the very start of our epoch
+    return args == "packet received at epoch start" or _xfer_error(rec, epoch, args, text)
+
+
+def _epoch_syncer_at_epoch(rec, epoch, args, text):
+    # late for end-of-epoch by <ticks> ticks
+    if not (args.startswith("late for end-of-epoch by ") and args.endswith(" ticks")):
+        return False
+    print "warning: node %d handled the end of epoch %d late by %s ticks" % (rec.nodeid, epoch, args[25:-6])
+    return True
+
+
+_HANDLERS = {
+    'board-id64' : _board_id64,
+    'xfer' : _xfer,
+    'Rime' : _rime,
+    'Starting' : _starting,
+    'epoch' : _epoch_interval,
+    'logbuf:' : _logbuf,
+    'epoch-syncer:' : _epoch_syncer,
+    'size-estimator:' : _size_estimator,
+    }
+
+_EPOCH_HANDLERS = {
+    'stats' : _stats,
+    'track' : _track,
+    # profiler statistics and airtime counters (see airtime-report.py)
+    'prof' : _skip,
+    'air' : _skip,
+    'energest' : _skip,
+    # the on-node size estimates and change tests are recomputed from the
+    # statistics
+    'estim' : _skip,
+    'glr' : _skip,
+    'size-estimator' : _size_estimator_at_epoch,
+    'data' : _xfer_error,
+    'sync' : _epoch_syncer_sync,
+    'epoch-syncer:' : _epoch_syncer_at_epoch,
+    }
+
+
+def _split(l, quiet = False):
+    """Return the node id and the text lines of a `[nodeid] text` log line
+    (binary records are decoded), or None if the line can't be used.
+    """
+    end = l.find('] ')
+    if end < 2 or not l.startswith('[') or not l[1:end].isdigit():
+        if not quiet:
+            print " ! cannot match \"%s\"" % l
+        return None
+
+    nodeid = int(l[1:end])
+    text = l[end+2:]
+
+    if binlog.is_record(text):
+        # binary records are decoded into the equivalent text lines
+        texts = binlog.decode(text)
+        if texts is None:
+            print " ! corrupted binary record from node %d" % nodeid
+            return None
+    else:
+        texts = (text,)
+
+    return (nodeid, texts)
+
+
+def _dispatch(rec, text, quiet = False):
+    rec.nr_lines += 1
+
+    handler = None
+    epoch = None
+    if text.startswith('@'):
+        epoch_str, sep, body = text[1:].partition(' ')
+        if epoch_str.isdigit():
+            epoch = int(epoch_str)
+            kind, sep, args = body.partition(' ')
+            handler = _EPOCH_HANDLERS.get(kind)
+    else:
+        kind, sep, args = text.partition(' ')
+        handler = _HANDLERS.get(kind)
+        if handler is None and kind.startswith('MAC'):
+            handler = _mac
+
+    if handler is None or not handler(rec, epoch, args, text):
+        if not quiet:
+            print text
+
+
+#
+# Parsed log cache
+#
+# The records are cached in the `<log>.parsed` folder: the scalar fields of all
+# nodes go in a json index together with the parser version and the size,
+# mtime and sha1 of the log; each column of each node is dumped raw, in native
+# byte order, to `<nodeid>.<column>` (these can be loaded with array.fromfile()
+# or memory-mapped with numpy.memmap()).
+#
+# The cache is valid if the log has the same size and mtime or, failing that,
+# the same sha1 (e.g. the log was copied). The cache of logs with a different
+# sha1, or written by a different parser version, is rebuilt.
+#
+_SCALARS = ('nr_lines', 'board_id64', 'xfer_crc', 'M', 'D', 'synced_epoch', 'synced_ticks', 'error')
+_COLUMNS = ('stats_epoch', 'stats_value', 'stats_exp',
+            'sync_epoch', 'sync_board_id16', 'sync_count',
+            'data_epoch', 'data_board_id16', 'data_count')
+
+
+def _cache_path(log_path):
+    return log_path + '.parsed'
+
+
+def _sha1(path):
+    h = hashlib.sha1()
+    with open(path, 'rb') as f:
+        while True:
+            chunk = f.read(1 << 20)
+            if not chunk:
+                break
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def _column_types():
+    rec = NodeRecords(0)
+    return dict((c, [getattr(rec, c).typecode, getattr(rec, c).itemsize]) for c in _COLUMNS)
+
+
+def _load_cache(log_path):
+    cache_path = _cache_path(log_path)
+    try:
+        with open(os.path.join(cache_path, 'index')) as f:
+            index = json.load(f)
+    except (IOError, ValueError):
+        return None
+
+    if index.get('version') != PARSER_VERSION or index.get('byteorder') != sys.byteorder or index.get('columns') != _column_types():
+        return None
+
+    st = os.stat(log_path)
+    if index['size'] != st.st_size:
+        return None
+
+    if index['mtime'] != st.st_mtime:
+        if index['sha1'] != _sha1(log_path):
+            return None
+        # same log with a new mtime, skip the hash next time
+        index['mtime'] = st.st_mtime
+        try:
+            with open(os.path.join(cache_path, 'index'), 'w') as f:
+                json.dump(index, f)
+        except IOError:
+            pass
+
+    records = {}
+    try:
+        for nodeid, scalars in index['nodes'].items():
+            rec = NodeRecords(int(nodeid))
+            for name in _SCALARS:
+                setattr(rec, name, scalars[name])
+            for name in _COLUMNS:
+                col = getattr(rec, name)
+                with open(os.path.join(cache_path, '%s.%s' % (nodeid, name)), 'rb') as f:
+                    col.fromfile(f, scalars['len'][name])
+            records[rec.nodeid] = rec
+    except (IOError, EOFError, KeyError):
+        return None
+
+    return records
+
+
+def _store_cache(log_path, records):
+    cache_path = _cache_path(log_path)
+    tmp_path = cache_path + '.tmp'
+    st = os.stat(log_path)
+
+    index = {
+        'version' : PARSER_VERSION,
+        'byteorder' : sys.byteorder,
+        'columns' : _column_types(),
+        'size' : st.st_size,
+        'mtime' : st.st_mtime,
+        'sha1' : _sha1(log_path),
+        'nodes' : {},
+        }
+
+    try:
+        if os.path.exists(tmp_path):
+            shutil.rmtree(tmp_path)
+        os.mkdir(tmp_path)
+
+        for nodeid, rec in records.items():
+            scalars = dict((name, getattr(rec, name)) for name in _SCALARS)
+            scalars['len'] = {}
+            for name in _COLUMNS:
+                col = getattr(rec, name)
+                scalars['len'][name] = len(col)
+                with open(os.path.join(tmp_path, '%d.%s' % (nodeid, name)), 'wb') as f:
+                    col.tofile(f)
+            index['nodes'][str(nodeid)] = scalars
+
+        # the index is written last: a cache without it is never loaded
+        with open(os.path.join(tmp_path, 'index'), 'w') as f:
+            json.dump(index, f)
+
+        if os.path.exists(cache_path):
+            shutil.rmtree(cache_path)
+        os.rename(tmp_path, cache_path)
+    except (IOError, OSError) as e:
+        print "warning: cannot write the parsed log cache %s (%s)" % (cache_path, e)
+
+
+def parse(log_path, output_split_logs = False, use_cache = True):
+    """Parse the experiment log at log_path in a single pass.
+
+    Return a dict with the NodeRecords of each node id. When output_split_logs
+    is True the lines of each node are also written to node-<id>.log next to
+    the experiment log (existing files are not overwritten).
+
+    When use_cache is True the records are loaded from the parsed log cache if
+    valid, otherwise the log is parsed and the cache rebuilt.
+
+    ! the warnings printed while parsing are not repeated when loading from
+      the cache
+    """
+    if use_cache and not output_split_logs:
+        records = _load_cache(log_path)
+        if records is not None:
+            print "Loaded the parsed log from %s" % _cache_path(log_path)
+            return records
+
+    records = {}
+    split_logs = {}
+    experiment_dir = os.path.dirname(log_path)
+
+    with open(log_path) as log:
+        for l in log:
+            split = _split(l.rstrip('\n'))
+            if split is None:
+                continue
+            nodeid, texts = split
+
+            rec = records.get(nodeid)
+            if rec is None:
+                rec = NodeRecords(nodeid)
+                records[nodeid] = rec
+
+                if output_split_logs:
+                    nodelog_path = os.path.join(experiment_dir, ''.join(('node-', str(nodeid), '.log')))
+                    if not os.path.exists(nodelog_path):
+                        print "Writing log for node with id %d" % nodeid
+                        split_logs[nodeid] = open(nodelog_path, 'w')
+
+            if nodeid in split_logs:
+                for t in texts:
+                    split_logs[nodeid].write(t + '\n')
+
+            if rec.error is not None:
+                continue
+
+            for t in texts:
+                _dispatch(rec, t)
+
+    for f in split_logs.values():
+        f.close()
+
+    if use_cache:
+        _store_cache(log_path, records)
+
+    return records
+
+
+def parse_line(records, l, quiet = False):
+    """Parse one `[nodeid] text` log line into the NodeRecords of its node in
+    the dict records (created if missing), for the streaming consumers.
+
+    Return the NodeRecords, or None if the line can't be used. When quiet is
+    True the lines that can't be matched or handled are not echoed, the
+    warnings are still printed.
+    """
+    split = _split(l.rstrip('\n'), quiet)
+    if split is None:
+        return None
+    nodeid, texts = split
+
+    rec = records.get(nodeid)
+    if rec is None:
+        rec = NodeRecords(nodeid)
+        records[nodeid] = rec
+
+    for t in texts:
+        _dispatch(rec, t, quiet)
+    return rec
@@ -23,10 +23,12 @@
 
 import os
 import re
+import binlog
+import logparser
 from node import Node
 
 class Network():
-    def __init__(self, site, log_path, output_split_logs = False):
+    def __init__(self, site, log_path, output_split_logs = False, use_cache = True):
         assert site is not None
         assert isinstance(site, str)
         assert log_path is not None
@@ -35,14 +37,14 @@ class Network():
         self._initialized = False
         self._nodes = None
 
-        nodelogs = _split_node_data(log_path, output_split_logs)
+        nodelogs = logparser.parse(log_path, output_split_logs, use_cache)
 
         nodes = {}
-        for nodeid, log in nodelogs.items():
+        for nodeid, records in nodelogs.items():
             print " * Loading data for node nr. %d ..." % nodeid
             assert not (nodeid in nodes.keys())
         
-            node = Node(site, nodeid, log)
+            node = Node(site, nodeid, records)
 
             if node.initialized():
                 nodes[nodeid] = node
@@ -72,18 +74,27 @@ class Network():
 
     @staticmethod
     def _split_node_data(log_path, output_split_logs):
+        # ! this keeps the whole log in memory, use logparser.parse()
         nodelogs = {}
 
-        lines = file(log_path).readlines()
-        for l in lines:
+        for l in file(log_path):
             m = re.search(r'^\[([0-9]+)\] (.*)', l)
             if m is not None:
                 nodeid = int(m.group(1))
                 text = m.group(2)
+                if binlog.is_record(text):
+                    # binary records are decoded into the equivalent text lines
+                    texts = binlog.decode(text)
+                    if texts is None:
+                        print " ! corrupted binary record from node %d" % nodeid
+                        continue
+                else:
+                    texts = [text]
+
                 if nodeid in nodelogs.keys():
-                    nodelogs[nodeid].append(text)
+                    nodelogs[nodeid].extend(texts)
                 else:
-                    nodelogs[nodeid] = [text]
+                    nodelogs[nodeid] = texts
             else:
                 print " ! cannot match \"%s\"" % l
                 continue
@@ -21,13 +21,12 @@
 #    distribution.
 
 
-import re
 import siteinfo
 
 class Node:
-    def __init__(self, site, nodeid, nodelog):
-        assert nodelog is not None
-        assert len(nodelog) > 0
+    def __init__(self, site, nodeid, records):
+        assert records is not None
+        assert records.nodeid == nodeid
         assert nodeid == int(nodeid)
         assert nodeid >= 1 and nodeid<=256
 
@@ -42,39 +41,11 @@ class Node:
             print "error: unknown site %s" % site
             return
 
-        i = 0
-        while i < len(nodelog):
-            line = nodelog[i]
-            if line.startswith("Rime started with address"):
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("MAC") and "Contiki 2.5 started" in line:
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("board-id64"):
-                if self._board_id64 is None:
-                    m = re.search(r'^board-id64 (0x[0-9a-f]+)$', line)
-                    if m is not None:
-                        self._board_id64 = int(m.group(1),16)
-                        self._board_id16 = (self._board_id64 & 0x0000ff0000000000) >> 32 | (self._board_id64 & 0x00ff000000000000) >> 48
-
-                        #print "node-id64/16 0x%.16x/0x%.4x" % (self._board_id64, self._board_id16)
-                nodelog.pop(i)
-                continue
-
-            if line.startswith("xfer crc"):
-                m = re.search(r'^xfer crc([0-9]+)$', line)
-                if m is not None:
-                    self._xfer_crc = int(m.group(1))
-
-                    #print "node-id64/16 0x%.16x/0x%.4x" % (self._board_id64, self._board_id16)
-                    nodelog.pop(i)
-                    continue
-
-            # go to the next line
-            i += 1
+        # see logparser.py
+        self._board_id64 = records.board_id64
+        self._xfer_crc = records.xfer_crc
+        if self._board_id64 is not None:
+            self._board_id16 = (self._board_id64 & 0x0000ff0000000000) >> 32 | (self._board_id64 & 0x00ff000000000000) >> 48
 
         if self._board_id64 is None:
             print "warning: board-id entry not found"
@@ -0,0 +1,257 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Collect the serial output of many nodes into an experiment log
+#
+# The serial devices (or the ptys opened by log-replay.py) are multiplexed
+# with epoll, the lines of each device are split and written to the log as
+# the `[nodeid] text` lines of the senslab serial aggregator, in the order
+# they are received.
+#
+# The receive time of each line (unix time, seconds) is appended to
+# `<log>.rxtime`, one native float64 per log line: the log format is left
+# untouched for the parsers. The log is written with large buffered writes
+# and flushed at least every FLUSH_INTERVAL seconds.
+#
+# With --online the lines are also fed to the online change detector (see
+# change_detection/online.py).
+#
+
+import os
+import sys
+import time
+import errno
+import select
+import signal
+import termios
+import tty
+from array import array
+
+# seconds between two flushes of the log and between two rate reports
+FLUSH_INTERVAL = 1.
+REPORT_INTERVAL = 5.
+
+LOG_BUFFER_SIZE = 1 << 20
+READ_SIZE = 1 << 16
+
+# a line longer than this is cut (the node is writing garbage)
+MAX_LINE_LENGTH = 4096
+
+BAUDRATES = {
+    9600 : termios.B9600,
+    19200 : termios.B19200,
+    38400 : termios.B38400,
+    57600 : termios.B57600,
+    115200 : termios.B115200,
+    230400 : termios.B230400,
+    }
+
+
+class Device(object):
+    def __init__(self, nodeid, path, baudrate):
+        self.nodeid = nodeid
+        self.path = path
+        self.fd = os.open(path, os.O_RDONLY | os.O_NONBLOCK | os.O_NOCTTY)
+        if os.isatty(self.fd):
+            # ! TCSANOW: TCSAFLUSH would discard the lines already received
+            tty.setraw(self.fd, termios.TCSANOW)
+            attrs = termios.tcgetattr(self.fd)
+            attrs[4] = attrs[5] = BAUDRATES[baudrate]
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+
+        self.partial = ''
+        self.nr_lines = 0
+        self.nr_bytes = 0
+
+    def read_lines(self):
+        """Return the complete lines read, or None at the end of the stream."""
+        try:
+            data = os.read(self.fd, READ_SIZE)
+        except OSError as e:
+            if e.errno == errno.EAGAIN:
+                return []
+            if e.errno == errno.EIO:
+                # the other end of the pty was closed
+                return None
+            raise
+
+        if not data:
+            return None
+        self.nr_bytes += len(data)
+
+        lines = (self.partial + data).split('\n')
+        self.partial = lines.pop()
+        if len(self.partial) > MAX_LINE_LENGTH:
+            lines.append(self.partial)
+            self.partial = ''
+
+        lines = [l.rstrip('\r') for l in lines]
+        self.nr_lines += len(lines)
+        return lines
+
+    def close(self):
+        os.close(self.fd)
+
+
+def _read_map(map_path):
+    devices = []
+    with open(map_path) as f:
+        for l in f:
+            fields = l.split()
+            if not len(fields) or fields[0].startswith('#'):
+                continue
+            if len(fields) != 2 or not fields[0].isdigit():
+                raise ValueError("cannot parse \"%s\"" % l.strip())
+            devices.append((int(fields[0]), fields[1]))
+    return devices
+
+
+def collect(devices, log_path, online = None):
+    """Collect until interrupted or until all the devices are closed."""
+    stop = [False]
+    def handler_stop(signum, frame):
+        stop[0] = True
+    signal.signal(signal.SIGINT, handler_stop)
+    signal.signal(signal.SIGTERM, handler_stop)
+
+    log = open(log_path, 'a', LOG_BUFFER_SIZE)
+    rxtime = open(log_path + '.rxtime', 'ab', LOG_BUFFER_SIZE)
+
+    epoll = select.epoll()
+    fds = {}
+    for dev in devices:
+        epoll.register(dev.fd, select.EPOLLIN)
+        fds[dev.fd] = dev
+
+    start = time.time()
+    last_flush = start
+    last_report = start
+    nr_lines = 0
+    last_report_lines = 0
+
+    try:
+        while not stop[0] and len(fds):
+            try:
+                events = epoll.poll(FLUSH_INTERVAL)
+            except IOError as e:
+                if e.errno == errno.EINTR:
+                    continue
+                raise
+
+            now = time.time()
+            for fd, event in events:
+                dev = fds[fd]
+                lines = dev.read_lines() if event & (select.EPOLLIN | select.EPOLLHUP | select.EPOLLERR) else []
+                if lines is None:
+                    print >> sys.stderr, "collector: node %d closed %s" % (dev.nodeid, dev.path)
+                    epoll.unregister(fd)
+                    del fds[fd]
+                    continue
+
+                if not len(lines):
+                    continue
+
+                merged = ['[%d] %s\n' % (dev.nodeid, l) for l in lines]
+                log.write(''.join(merged))
+                array('d', [now]*len(lines)).tofile(rxtime)
+                nr_lines += len(lines)
+
+                if online is not None:
+                    for l in merged:
+                        online.feed(l)
+
+            if now - last_flush >= FLUSH_INTERVAL:
+                log.flush()
+                rxtime.flush()
+                last_flush = now
+
+            if now - last_report >= REPORT_INTERVAL:
+                print >> sys.stderr, "collector: %d devices, %.0f lines/s, %d lines" % (len(fds), (nr_lines - last_report_lines)/(now - last_report), nr_lines)
+                last_report = now
+                last_report_lines = nr_lines
+    finally:
+        epoll.close()
+        log.close()
+        rxtime.close()
+
+    elapsed = time.time() - start
+    print >> sys.stderr, "collector: %d lines in %.1f s (%.0f lines/s)" % (nr_lines, elapsed, nr_lines/max(elapsed, 1e-3))
+    for dev in sorted(devices, key = lambda d : d.nodeid):
+        if dev.partial:
+            print >> sys.stderr, "collector: node %d, dropped a partial line" % dev.nodeid
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser(usage="usage: %prog [options] [nodeid:device ...]")
+    parser.add_option("-m", "--map", dest="map",
+                      help="read the `nodeid device` pairs from `path` (e.g. the pty map of log-replay.py).", metavar="path")
+    parser.add_option("-o", "--output", dest="output", default="experiment.log",
+                      help="append the merged lines to `path` (default: experiment.log).", metavar="path")
+    parser.add_option("-b", "--baudrate", type="int", dest="baudrate", default=115200,
+                      help="the baudrate of the serial devices (default: 115200).", metavar="baud")
+    parser.add_option("--online", action="store_true", dest="online", default=False,
+                      help="also run the online change detection on the collected lines.")
+
+    (options, args) = parser.parse_args()
+
+    pairs = []
+    try:
+        if options.map:
+            pairs.extend(_read_map(options.map))
+        for arg in args:
+            nodeid, sep, path = arg.partition(':')
+            if not nodeid.isdigit() or not path:
+                raise ValueError("cannot parse \"%s\"" % arg)
+            pairs.append((int(nodeid), path))
+    except (IOError, ValueError) as e:
+        print "error: %s" % e
+        sys.exit(0)
+
+    if not len(pairs):
+        print "error: no devices given.\n"
+        parser.print_help()
+        sys.exit(0)
+
+    if options.baudrate not in BAUDRATES:
+        print "error: unsupported baudrate %d." % options.baudrate
+        sys.exit(0)
+
+    devices = []
+    for nodeid, path in pairs:
+        try:
+            devices.append(Device(nodeid, path, options.baudrate))
+        except OSError as e:
+            print "error: cannot open %s for node %d (%s)" % (path, nodeid, e.strerror)
+            sys.exit(0)
+
+    online = None
+    if options.online:
+        import change_detection.online
+        online = change_detection.online.OnlineDetector()
+
+    print >> sys.stderr, "Collecting %d devices into %s ..." % (len(devices), options.output)
+    collect(devices, options.output, online)
@@ -0,0 +1,61 @@
+# Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+#               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+#
+# This software is provided 'as-is', without any express or implied
+# warranty. In no event will the authors be held liable for any damages
+# arising from the use of this software.
+#
+# Permission is granted to anyone to use this software for any purpose,
+# including commercial applications, and to alter it and redistribute it
+# freely, subject to the following restrictions:
+#
+#    1. The origin of this software must not be misrepresented; you must not
+#    claim that you wrote the original software. If you use this software
+#    in a product, an acknowledgment in the product documentation would be
+#    appreciated but is not required.
+#
+#    2. Altered source versions must be plainly marked as such, and must not be
+#    misrepresented as being the original software.
+#
+#    3. This notice may not be removed or altered from any source
+#    distribution.
+
+
+
+#
+# Regenerate the legacy %d.NodesPositions and %d.LinksList text files from the
+# columnar state export written by change-detection.py (see
+# change_detection/export.py)
+#
+
+import os
+import sys
+
+import change_detection.export as export
+
+
+if __name__ == "__main__":
+    from optparse import OptionParser
+
+    parser = OptionParser(usage="usage: %prog [options] states-dir")
+    parser.add_option("-o", "--output", dest="output",
+                      help="write the text files to `dir` (default: the frames folder next to states-dir).", metavar="dir")
+
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        print "error: no state export given.\n"
+        parser.print_help()
+        sys.exit(0)
+
+    states_dir = args[0].rstrip('/')
+    if not os.path.isfile(os.path.join(states_dir, 'index')):
+        print "error: %s is not a state export." % states_dir
+        sys.exit(0)
+
+    frames_dir = options.output
+    if frames_dir is None:
+        frames_dir = os.path.join(os.path.dirname(os.path.abspath(states_dir)), 'frames')
+
+    print "Writing the text files of %s to %s ..." % (states_dir, frames_dir)
+    export.to_text(states_dir, frames_dir)
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include "crc16.h"
+#include "util.h"
+#include "binlog.h"
+
+
+/*
+ * The crc of the record being written
+ */
+static uint16_t _crc16;
+
+#ifndef NDEBUG
+static char _in_record = 0;
+#endif
+
+
+/*
+ * Records go to the logbuf when the log output is deferred
+ */
+#ifdef LOG_DEFERRED
+#define _binlog_out(c) logbuf_putc(c)
+#else
+#define _binlog_out(c) putchar(c)
+#endif
+
+
+/*
+ * Put a byte on the serial line, escaping the framing characters
+ */
+static void _binlog_putc(uint8_t c) {
+	if ((c == '\n') || (c == '\r') || (c == '\0') || (c == BINLOG_SENTINEL) || (c == BINLOG_ESCAPE)) {
+		_binlog_out(BINLOG_ESCAPE);
+		c ^= 0x20;
+	}
+	_binlog_out(c);
+}
+
+
+void binlog_put_u8(uint8_t val) {
+	assert(_in_record);
+
+	_crc16 = crc16_add(val, _crc16);
+	_binlog_putc(val);
+}
+
+
+void binlog_put_u16(uint16_t val) {
+	binlog_put_u8(val & 0xff);
+	binlog_put_u8(val >> 8);
+}
+
+
+void binlog_put_u32(uint32_t val) {
+	binlog_put_u16(val & 0xffff);
+	binlog_put_u16(val >> 16);
+}
+
+
+void binlog_begin(uint8_t type, uint16_t epoch) {
+	assert(!_in_record);
+
+	/*
+	 * ! a record is written atomically in the logbuf
+	 */
+	log_line_begin();
+	_binlog_out(BINLOG_SENTINEL);
+
+	_crc16 = 0;
+#ifndef NDEBUG
+	_in_record = 1;
+#endif
+	binlog_put_u8(type);
+
+	/*
+	 * the epoch as a LEB128 varint: most epochs fit in one or two bytes
+	 */
+	while (epoch >= 0x80) {
+		binlog_put_u8((epoch & 0x7f) | 0x80);
+		epoch >>= 7;
+	}
+	binlog_put_u8(epoch);
+}
+
+
+void binlog_end(void) {
+	uint16_t crc16;
+
+	assert(_in_record);
+
+	/*
+	 * ! the crc doesn't cover itself
+	 */
+	crc16 = _crc16;
+	_binlog_putc(crc16 & 0xff);
+	_binlog_putc(crc16 >> 8);
+	_binlog_out('\n');
+	log_line_end();
+
+#ifndef NDEBUG
+	_in_record = 0;
+#endif
+}
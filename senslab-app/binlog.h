@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include <stdint.h>
+#include "contiki.h"
+#include "size-estimator-conf.h"
+
+
+/*
+ * Binary log records
+ *
+ * When LOG_BINARY is defined the per-epoch logs (the sufficient statistics and
+ * the connection tracks) are written on the serial line as binary records
+ * instead of being printf-ed. Each record is framed as
+ *
+ *   BINLOG_SENTINEL type epoch payload crc16 '\n'
+ *
+ * - `epoch` is an unsigned LEB128 varint (1 to 3 bytes)
+ * - `payload` depends on the record type, multi-byte values are little endian
+ * - `crc16` is the Contiki crc16 of type, epoch and payload (little endian)
+ *
+ * Every byte after the sentinel equal to '\n', '\r', '\0', BINLOG_SENTINEL or
+ * BINLOG_ESCAPE is sent as BINLOG_ESCAPE followed by the byte xor 0x20: a
+ * record is always a single line in the serial log. The records are decoded by
+ * scripts/senslab/binlog.py
+ */
+#define BINLOG_SENTINEL            0x7e
+#define BINLOG_ESCAPE              0x7d
+
+/*
+ * Record types
+ *
+ * - BINLOG_REC_STATS, D x (uint32 value, int16 exp) sufficient statistics
+ * - BINLOG_REC_TRACK_SYNC, BINLOG_REC_TRACK_DATA, N x (uint16 board-id16, uint8 count)
+ * - BINLOG_REC_TRACK_OVERFLOW, (uint8 track type, uint16 count)
+ * - BINLOG_REC_ESTIMATES, D x uint32 size estimates (8 fractional bits)
+ *
+ * ! the values are shared with the host decoder: never renumber
+ */
+#define BINLOG_REC_STATS           0x01
+#define BINLOG_REC_TRACK_SYNC      0x02
+#define BINLOG_REC_TRACK_DATA      0x03
+#define BINLOG_REC_TRACK_OVERFLOW  0x04
+#define BINLOG_REC_ESTIMATES       0x05
+
+
+void binlog_begin(uint8_t type, uint16_t epoch);
+void binlog_put_u8(uint8_t val);
+void binlog_put_u16(uint16_t val);
+void binlog_put_u32(uint32_t val);
+void binlog_end(void);
+
+
+#endif /* __BINLOG_H__ */
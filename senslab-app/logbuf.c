@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include "contiki.h"
+#include "util.h"
+#include "logbuf.h"
+
+
+/*
+ * The ring buffer
+ *
+ * ! _head, _commit and _tail are free running counters: their differences are
+ *   the buffer occupancy whatever the wrap-around
+ *
+ * - bytes in [_tail, _commit) can be drained
+ * - bytes in [_commit, _head) belong to the line being written
+ */
+static char _buf[LOGBUF_SIZE];
+static uint16_t _head;
+static uint16_t _commit;
+static uint16_t _tail;
+
+static char _in_line;
+static char _line_failed;
+static uint16_t _line_start;
+
+//! The number of records dropped since the last report
+static uint16_t _dropped;
+
+
+static void _logbuf_commit(void) {
+	_commit = _head;
+	process_poll(&proc_log_drainer);
+}
+
+
+static void _logbuf_drop(void) {
+	if (_dropped < 0xffff)
+		_dropped++;
+	process_poll(&proc_log_drainer);
+}
+
+
+void logbuf_write(const char *data, uint16_t len) {
+	uint16_t offset, chunk;
+
+	if (_in_line && _line_failed)
+		return;
+
+	if (len > LOGBUF_SIZE - (uint16_t)(_head - _tail)) {
+		if (_in_line)
+			_line_failed = 1;
+		else
+			_logbuf_drop();
+		return;
+	}
+
+	/*
+	 * copy in (at most) two chunks: up to the end of the buffer and from its start
+	 */
+	offset = _head & (LOGBUF_SIZE - 1);
+	chunk = min(len, (uint16_t)(LOGBUF_SIZE - offset));
+	memcpy(&_buf[offset], data, chunk);
+	memcpy(_buf, data + chunk, len - chunk);
+	_head += len;
+
+	if (!_in_line)
+		_logbuf_commit();
+}
+
+
+void logbuf_putc(char c) {
+	logbuf_write(&c, 1);
+}
+
+
+int logbuf_printf(const char *fmt, ...) {
+	char line[LOGBUF_MAX_LINE];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return len;
+
+	len = min(len, (int)sizeof(line) - 1);
+	logbuf_write(line, len);
+	return len;
+}
+
+
+void logbuf_line_begin(void) {
+	assert(!_in_line);
+
+	_in_line = 1;
+	_line_failed = 0;
+	_line_start = _head;
+}
+
+
+void logbuf_line_end(void) {
+	assert(_in_line);
+
+	_in_line = 0;
+	if (_line_failed) {
+		/*
+		 * roll back the part of the line that did fit
+		 */
+		_head = _line_start;
+		_logbuf_drop();
+		return;
+	}
+
+	_logbuf_commit();
+}
+
+
+PROCESS_THREAD(proc_log_drainer, ev, data) {
+	PROCESS_BEGIN();
+
+	while (1) {
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+		while (_tail != _commit) {
+			uint16_t n;
+
+			/*
+			 * write a chunk and let the other processes run
+			 */
+			for (n=0; (n < LOGBUF_DRAIN_CHUNK) && (_tail != _commit); n++) {
+				putchar(_buf[_tail & (LOGBUF_SIZE - 1)]);
+				_tail++;
+			}
+
+			PROCESS_PAUSE();
+		}
+
+		if (_dropped) {
+			printf("logbuf: dropped %u records\n", _dropped);
+			_dropped = 0;
+		}
+	}
+
+	PROCESS_END();
+}
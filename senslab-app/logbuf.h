@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __LOGBUF_H__
+#define __LOGBUF_H__
+
+#include <stdint.h>
+#include "contiki.h"
+#include "size-estimator-conf.h"
+
+
+/*
+ * Deferred logging
+ *
+ * When LOG_DEFERRED is defined the log output (see log_printf() and trace()
+ * in util.h) is written in a RAM ring buffer of LOGBUF_SIZE bytes instead of
+ * the uart. The proc_log_drainer process writes the buffer to the uart, at
+ * most LOGBUF_DRAIN_CHUNK bytes at a time before yielding to the other
+ * processes: writing to the uart doesn't delay the epoch boundaries and the
+ * receive callbacks anymore.
+ *
+ * The writes that don't fit in the buffer are dropped and counted, the count
+ * is logged as `logbuf: dropped N records` once the buffer is drained.
+ *
+ * A line written with several calls can be made atomic by enclosing the calls
+ * in logbuf_line_begin() and logbuf_line_end(): if any part doesn't fit, the
+ * whole line is dropped.
+ *
+ * ! log_printf()-ed records are formatted on a stack buffer of LOGBUF_MAX_LINE
+ *   bytes: longer records are truncated
+ */
+#define LOGBUF_SIZE          (1024)
+#define LOGBUF_MAX_LINE      (96)
+#define LOGBUF_DRAIN_CHUNK   (32)
+
+
+PROCESS_NAME(proc_log_drainer);
+
+void logbuf_write(const char *data, uint16_t len);
+void logbuf_putc(char c);
+int logbuf_printf(const char *fmt, ...);
+void logbuf_line_begin(void);
+void logbuf_line_end(void);
+
+
+#if LOGBUF_SIZE & (LOGBUF_SIZE - 1)
+#error LOGBUF_SIZE must be a power of two
+#endif
+
+#if LOGBUF_SIZE > 32768
+#error choose LOGBUF_SIZE not greater than 32768
+#endif
+
+#endif /* __LOGBUF_H__ */
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdint.h>
+#include <assert.h>
+#include "fractional48.h"
+#include "log2-table.h"
+
+#if LOG2_TABLE_FRAC_BITS != FRACTIONAL48_LOG2_FRAC_BITS
+#error math/log2-table.h is stale, rebuild it with scripts/math/gen-log2-table.py
+#endif
+
+
+/*
+ * Return the log2 of the mantissa value/2^31, in [1,2), with
+ * FRACTIONAL48_LOG2_FRAC_BITS fractional bits: it is interpolated linearly
+ * between the table entries
+ */
+static uint32_t __log2_mantissa(fixpoint32_t value) {
+	uint8_t index;
+	uint32_t frac, lo, hi;
+
+	assert(value & 0x80000000ul);
+
+	index = (value >> (31 - LOG2_TABLE_BITS)) & ((1 << LOG2_TABLE_BITS) - 1);
+	frac = (value >> (31 - LOG2_TABLE_BITS - 16)) & 0xffff;
+	lo = __log2_table[index];
+	hi = __log2_table[index + 1];
+
+	return lo + (((hi - lo)*frac) >> 16);
+}
+
+
+/*
+ * Return -log2(f48) with FRACTIONAL48_LOG2_FRAC_BITS fractional bits
+ *
+ * f48 is (value/2^31)*2^(exp-1) with the mantissa value/2^31 in [1,2)
+ */
+uint32_t fractional48_neg_log2(const fractional48_t *f48) {
+	assert(f48 != NULL);
+	assert(f48->exp <= 0);
+
+	return ((uint32_t)(1 - f48->exp) << FRACTIONAL48_LOG2_FRAC_BITS) - __log2_mantissa(f48->value);
+}
+
+
+/*
+ * Return ln(f48) with FRACTIONAL48_LOG2_FRAC_BITS fractional bits
+ *
+ * ! unlike fractional48_neg_log2() f48 can be greater than 1
+ */
+int32_t fractional48_ln(const fractional48_t *f48) {
+	int32_t log2;
+
+	assert(f48 != NULL);
+
+	log2 = ((int32_t)(f48->exp - 1) << FRACTIONAL48_LOG2_FRAC_BITS) + (int32_t)__log2_mantissa(f48->value);
+	return (int32_t)(((int64_t)log2*LOG2_TABLE_LN2) >> LOG2_TABLE_FRAC_BITS);
+}
+
+
+/*
+ * Return M/-ln(f48) with FRACTIONAL48_ESTIMATE_FRAC_BITS fractional bits
+ *
+ * ! mirrored by fractional48_size_estimate() in scripts/math/fixpointops.py
+ */
+uint32_t fractional48_size_estimate(const fractional48_t *f48, uint16_t M) {
+	uint32_t neg_log2;
+	uint64_t estim;
+
+	assert(f48 != NULL);
+
+	if (f48->value == 0)
+		return 0;
+
+	neg_log2 = fractional48_neg_log2(f48);
+	if (neg_log2 == 0)
+		return (uint32_t)1 << FRACTIONAL48_ESTIMATE_FRAC_BITS;
+
+	estim = (((uint64_t)M*LOG2_TABLE_INV_LN2) << FRACTIONAL48_ESTIMATE_FRAC_BITS)/neg_log2;
+	if (estim > 0xfffffffful)
+		return 0xfffffffful;
+
+	return (uint32_t)estim;
+}
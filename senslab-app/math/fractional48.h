@@ -90,5 +90,28 @@ __always_inline__ void fractional48_mul(fractional48_t *f48, fixpoint32_t fix32)
 }
 
 
+
+/*
+ * Fixed-point logarithms
+ *
+ * fractional48_neg_log2() returns -log2(f48) and fractional48_ln() returns
+ * ln(f48), both with FRACTIONAL48_LOG2_FRAC_BITS fractional bits, from a log2
+ * table generated at build time by scripts/math/gen-log2-table.py (max error
+ * ~6e-5)
+ *
+ * fractional48_size_estimate() returns the size estimate M/-ln(f48) for the
+ * sufficient statistic f48 (the product of the M consensus values) with
+ * FRACTIONAL48_ESTIMATE_FRAC_BITS fractional bits
+ *
+ * ! both are meant to run once per epoch: they take a table lookup and a
+ *   64bit division
+ */
+#define FRACTIONAL48_LOG2_FRAC_BITS      16
+#define FRACTIONAL48_ESTIMATE_FRAC_BITS  8
+
+uint32_t fractional48_neg_log2(const fractional48_t *f48);
+int32_t fractional48_ln(const fractional48_t *f48);
+uint32_t fractional48_size_estimate(const fractional48_t *f48, uint16_t M);
+
 #endif /* __FRACTIONAL48_H__ */
 
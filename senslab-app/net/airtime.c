@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "contiki.h"
+#include "net/rime.h"
+#include "sys/energest.h"
+#include "util.h"
+#include "airtime.h"
+
+
+void airtime_tx_start(struct airtime_counters *c, uint16_t len) {
+	assert(c != NULL);
+
+	c->tx_packets++;
+	c->tx_bytes += len;
+	c->tx_start = RTIMER_NOW();
+	c->tx_pending = 1;
+}
+
+
+void airtime_tx_done(struct airtime_counters *c, int status) {
+	assert(c != NULL);
+
+	/*
+	 * the sent callback of a transmission that was not accounted
+	 */
+	if (!c->tx_pending)
+		return;
+
+	c->tx_pending = 0;
+	c->tx_time += (rtimer_clock_t)(RTIMER_NOW() - c->tx_start);
+	if (status != MAC_TX_OK)
+		c->tx_failed++;
+}
+
+
+void airtime_print_and_zero(struct airtime_counters *c, const char *name, uint16_t epoch) {
+	rtimer_clock_t tx_start;
+	uint8_t tx_pending;
+
+	assert(c != NULL);
+
+	log_printf("@%d air %s %u %u %lu %lu %u %lu %u %u\n", epoch, name,
+		   c->tx_packets, c->tx_failed, (unsigned long int)c->tx_bytes, (unsigned long int)c->tx_time,
+		   c->rx_packets, (unsigned long int)c->rx_bytes, c->crc_errors, c->discarded);
+
+	/*
+	 * a transmission can be in flight at the epoch end: keep its start time,
+	 * its airtime is accounted in the next epoch
+	 */
+	tx_start = c->tx_start;
+	tx_pending = c->tx_pending;
+	memset(c, 0, sizeof(struct airtime_counters));
+	c->tx_start = tx_start;
+	c->tx_pending = tx_pending;
+}
+
+
+void airtime_print_energest(uint16_t epoch) {
+#if ENERGEST_CONF_ON
+	static unsigned long int last[4];
+	unsigned long int now[4];
+	uint8_t i;
+
+	energest_flush();
+	now[0] = energest_type_time(ENERGEST_TYPE_CPU);
+	now[1] = energest_type_time(ENERGEST_TYPE_LPM);
+	now[2] = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+	now[3] = energest_type_time(ENERGEST_TYPE_LISTEN);
+
+	log_printf("@%d energest %lu %lu %lu %lu\n", epoch, now[0] - last[0], now[1] - last[1], now[2] - last[2], now[3] - last[3]);
+
+	for (i=0; i < 4; i++)
+		last[i] = now[i];
+#endif
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __AIRTIME_H__
+#define __AIRTIME_H__
+
+#include <stdint.h>
+#include "contiki.h"
+#include "size-estimator-conf.h"
+
+
+/*
+ * Airtime and energy accounting
+ *
+ * When AIRTIME_ACCOUNTING is defined the epoch-syncer and the size-estimator
+ * count, for their own broadcast channel, the packets and payload bytes sent
+ * and received, the failed transmissions, the packets dropped because
+ * corrupted and those discarded because they belong to another epoch, and
+ * the time spent transmitting (from broadcast_send() to the sent callback, in
+ * rtimer ticks). The counters are logged and zeroed at each epoch end as
+ *
+ *   @epoch air channel txp txfail txbytes txtime rxp rxbytes crc disc
+ *
+ * When Contiki's energest is enabled (ENERGEST_CONF_ON) the epoch-syncer also
+ * logs the cpu, lpm, tx and listen times spent in the epoch (rtimer ticks)
+ *
+ *   @epoch energest cpu lpm tx listen
+ *
+ * The logs are aggregated by scripts/airtime-report.py
+ */
+struct airtime_counters {
+	uint16_t tx_packets;
+	uint16_t tx_failed;
+	uint32_t tx_bytes;
+	uint32_t tx_time;
+	uint16_t rx_packets;
+	uint32_t rx_bytes;
+	uint16_t crc_errors;
+	uint16_t discarded;
+
+	//! The time the last transmission started
+	rtimer_clock_t tx_start;
+
+	//! Non zero from airtime_tx_start() to airtime_tx_done()
+	uint8_t tx_pending;
+};
+
+
+#ifdef AIRTIME_ACCOUNTING
+#define AIRTIME_TX_START(c, len) airtime_tx_start(c, len)
+#define AIRTIME_TX_DONE(c, status) airtime_tx_done(c, status)
+#define AIRTIME_RX(c, len) {(c)->rx_packets++; (c)->rx_bytes += (len);}
+#define AIRTIME_CRC_ERROR(c) {(c)->crc_errors++;}
+#define AIRTIME_DISCARD(c) {(c)->discarded++;}
+#define AIRTIME_PRINT_AND_ZERO(c, name, epoch) airtime_print_and_zero(c, name, epoch)
+#define AIRTIME_PRINT_ENERGEST(epoch) airtime_print_energest(epoch)
+#else
+#define AIRTIME_TX_START(c, len) {}
+#define AIRTIME_TX_DONE(c, status) {}
+#define AIRTIME_RX(c, len) {}
+#define AIRTIME_CRC_ERROR(c) {}
+#define AIRTIME_DISCARD(c) {}
+#define AIRTIME_PRINT_AND_ZERO(c, name, epoch) {}
+#define AIRTIME_PRINT_ENERGEST(epoch) {}
+#endif
+
+
+void airtime_tx_start(struct airtime_counters *c, uint16_t len);
+void airtime_tx_done(struct airtime_counters *c, int status);
+void airtime_print_and_zero(struct airtime_counters *c, const char *name, uint16_t epoch);
+void airtime_print_energest(uint16_t epoch);
+
+
+#endif /* __AIRTIME_H__ */
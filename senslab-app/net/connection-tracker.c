@@ -24,16 +24,28 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "util.h"
 #include "connection-tracker.h"
+#ifdef LOG_BINARY
+#include "binlog.h"
+#endif
 
 
 struct connection_tracker_node {
 	uint16_t board_id16;
+
+	//! Non zero if the slot was ever used: free slots end the probe sequences
+	uint8_t used;
 	uint8_t count[CONNECTION_TRACKER_NR_TYPES];
 };
 
 struct connection_tracker {
 	struct connection_tracker_node nodes[CONNECTION_TRACKER_MAX_NODES];
+
+	//! The number of connections that could not be tracked since the last print
+	uint16_t overflows[CONNECTION_TRACKER_NR_TYPES];
 };
 
 
@@ -46,34 +58,54 @@ static struct connection_tracker _tracker;
 
 
 static void connection_tracker_init(void) {
-	int i;
-
 	if (_initialized)
 		return;
 
-	for (i=0; i < CONNECTION_TRACKER_MAX_NODES; i++) {
-		int j;
-		for (j=0; j < CONNECTION_TRACKER_NR_TYPES; j++) {
-			_tracker.nodes[i].count[j] = 0;
-		}
-	}
+	memset(&_tracker, 0, sizeof(struct connection_tracker));
 	_initialized = 1;
 }
 
 
+/*
+ * Fibonacci hashing: board ids are not uniformly distributed, multiplying by
+ * 2^16/phi spreads them over the whole table
+ */
+static inline uint16_t _connection_tracker_hash(uint16_t board_id16) {
+	return ((uint16_t)(board_id16*40503u)) >> (16 - CONNECTION_TRACKER_SIZE_BITS);
+}
+
+
+/*
+ * A node is idle if no connection was tracked since the last print, its slot
+ * can then be reused
+ */
+static inline char _connection_tracker_node_idle(const struct connection_tracker_node *node) {
+	int j;
+
+	for (j=0; j < CONNECTION_TRACKER_NR_TYPES; j++) {
+		if (node->count[j])
+			return 0;
+	}
+	return 1;
+}
+
+
 static void _connection_track_print(int type, uint16_t board_id16, uint16_t epoch) {
 	if (type == CONNECTION_TRACK_SYNC) {
-		printf("@%d track sync %.4x:1\n", epoch, board_id16);
+		log_printf("@%d track sync %.4x:1\n", epoch, board_id16);
 	} else if (type == CONNECTION_TRACK_DATA) {
-		printf("@%d track data %.4x:1\n", epoch, board_id16);
+		log_printf("@%d track data %.4x:1\n", epoch, board_id16);
 	} else {
-		printf("@%d track unknown %.4x:1\n", epoch, board_id16);
+		log_printf("@%d track unknown %.4x:1\n", epoch, board_id16);
 	}
 }
 
 
 void connection_track(int type, uint16_t board_id16, uint16_t epoch) {
 	int i;
+	uint16_t slot;
+	struct connection_tracker_node *node;
+	struct connection_tracker_node *victim;
 
 	assert(type >= __CONNECTION_TRACK_FIRST);
 	assert(type <= __CONNECTION_TRACK_LAST);
@@ -86,13 +118,28 @@ void connection_track(int type, uint16_t board_id16, uint16_t epoch) {
 		return;
 	}
 
-	for (i=0; i < CONNECTION_TRACKER_MAX_NODES; i++) {
-		if (_tracker.nodes[i].board_id16 == board_id16) {
+	/*
+	 * linear probing from the hash slot
+	 *
+	 * ! slots are never freed, only reused: a node is always found before the
+	 *   first free slot of its probe sequence
+	 */
+	victim = NULL;
+	slot = _connection_tracker_hash(board_id16);
+	for (i=0; i < CONNECTION_TRACKER_MAX_PROBES; i++) {
+		node = &_tracker.nodes[slot];
+
+		if (!node->used) {
+			victim = node;
+			break;
+		}
+
+		if (node->board_id16 == board_id16) {
 			/*
 			 * we found an entry with this id
 			 */
-			if (_tracker.nodes[i].count[type] < 0xff) {
-				_tracker.nodes[i].count[type]++;
+			if (node->count[type] < 0xff) {
+				node->count[type]++;
 			} else {
 				/*
 				 * we have space to count up to 0xff hits per epoch, track this
@@ -102,33 +149,30 @@ void connection_track(int type, uint16_t board_id16, uint16_t epoch) {
 			}
 			return;
 		}
+
+		/*
+		 * remember the first idle node of the probe sequence: reusing the
+		 * slot closest to the hash slot keeps the probe sequences short
+		 */
+		if ((victim == NULL) && _connection_tracker_node_idle(node))
+			victim = node;
+
+		slot = (slot + 1) & (CONNECTION_TRACKER_MAX_NODES - 1);
 	}
 
 	/*
-	 * no entry with the given board_id16 was found
-	 *
-	 * check if we can reuse an empty slot, i.e. an entry that has `.count`
-	 * equal to zero for all tracked types
+	 * no entry with the given board_id16 was found: take the free slot or
+	 * evict the chosen idle node
 	 */
-	for (i=0; i < CONNECTION_TRACKER_MAX_NODES; i++) {
-		int j;
-		char found;
-		found = 1;
-		for (j=0; j < CONNECTION_TRACKER_NR_TYPES; j++) {
-			if (_tracker.nodes[i].count[j]) {
-				found = 0;
-				break;
-			}
-		}
-
-		if (found) {
-			_tracker.nodes[i].board_id16 = board_id16;
-			_tracker.nodes[i].count[type] = 1;
-			return;
-		}
+	if (victim == NULL) {
+		if (_tracker.overflows[type] < 0xffff)
+			_tracker.overflows[type]++;
+		return;
 	}
 
-	_connection_track_print(type, board_id16, epoch);
+	victim->board_id16 = board_id16;
+	victim->used = 1;
+	victim->count[type] = 1;
 }
 
 
@@ -147,18 +191,45 @@ void connection_print_and_zero(int type, uint16_t epoch) {
 	if ((type < __CONNECTION_TRACK_FIRST) || (type > __CONNECTION_TRACK_LAST))
 		return;
 
+#ifdef LOG_BINARY
+	binlog_begin((type == CONNECTION_TRACK_SYNC) ? BINLOG_REC_TRACK_SYNC : BINLOG_REC_TRACK_DATA, epoch);
+	for (i=0; i < CONNECTION_TRACKER_MAX_NODES; i++) {
+		if (_tracker.nodes[i].count[type]) {
+			binlog_put_u16(_tracker.nodes[i].board_id16);
+			binlog_put_u8(_tracker.nodes[i].count[type]);
+			_tracker.nodes[i].count[type] = 0;
+		}
+	}
+	binlog_end();
+
+	if (_tracker.overflows[type]) {
+		binlog_begin(BINLOG_REC_TRACK_OVERFLOW, epoch);
+		binlog_put_u8(type);
+		binlog_put_u16(_tracker.overflows[type]);
+		binlog_end();
+		_tracker.overflows[type] = 0;
+	}
+#else
+	log_line_begin();
 	if (type == CONNECTION_TRACK_SYNC) {
-		printf("@%d track sync", epoch);
+		log_printf("@%d track sync", epoch);
 	} else if (type == CONNECTION_TRACK_DATA) {
-		printf("@%d track data", epoch);
+		log_printf("@%d track data", epoch);
 	}
 
 	for (i=0; i < CONNECTION_TRACKER_MAX_NODES; i++) {
 		if (_tracker.nodes[i].count[type]) {
-			printf(" %.4x:%d", _tracker.nodes[i].board_id16, _tracker.nodes[i].count[type]);
+			log_printf(" %.4x:%d", _tracker.nodes[i].board_id16, _tracker.nodes[i].count[type]);
 			_tracker.nodes[i].count[type] = 0;
 		}
 	}
-	printf("\n");
+	log_printf("\n");
+	log_line_end();
+
+	if (_tracker.overflows[type]) {
+		log_printf("@%d track overflow %s %d\n", epoch, (type == CONNECTION_TRACK_SYNC) ? "sync" : "data", _tracker.overflows[type]);
+		_tracker.overflows[type] = 0;
+	}
+#endif
 }
 
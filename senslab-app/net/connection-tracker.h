@@ -40,12 +40,45 @@
 
 #define CONNECTION_TRACKER_NR_TYPES (__CONNECTION_TRACK_LAST + 1)
 
-#define CONNECTION_TRACKER_MAX_NODES 40
+/*
+ * The tracker is an open-addressing hash table keyed by the board-id16
+ *
+ * - CONNECTION_TRACKER_SIZE_BITS sets the table capacity to 2^bits nodes
+ * - a node is looked up at most CONNECTION_TRACKER_MAX_PROBES slots away
+ *   from its hash slot: a lookup touches a constant number of slots
+ * - a slot is reused (evicted) only when all its per-epoch counts are zero,
+ *   the idle slot closest to the hash slot is evicted first
+ *
+ * ! a node whose probe window has no free or idle slot is dropped (and
+ *   counted) even if the table has room elsewhere. Probing the whole table
+ *   (CONNECTION_TRACKER_MAX_PROBES = CONNECTION_TRACKER_MAX_NODES) avoids
+ *   this but makes the first packet of every new node O(table) once the
+ *   table has filled up. See scripts/host/connection-tracker-bench.c
+ *
+ * ! packets from nodes that find no slot are counted and the count is
+ *   reported at each print (`@epoch track overflow type count`)
+ */
+#ifndef CONNECTION_TRACKER_SIZE_BITS
+#define CONNECTION_TRACKER_SIZE_BITS  6
+#endif
+#define CONNECTION_TRACKER_MAX_NODES  (1 << CONNECTION_TRACKER_SIZE_BITS)
+
+#ifndef CONNECTION_TRACKER_MAX_PROBES
+#define CONNECTION_TRACKER_MAX_PROBES 8
+#endif
 
 #if __CONNECTION_TRACK_FIRST != 0
 #error The connection tracker types must start at zero (and cannot contain holes).
 #endif
 
+#if CONNECTION_TRACKER_SIZE_BITS < 1 || CONNECTION_TRACKER_SIZE_BITS > 12
+#error choose CONNECTION_TRACKER_SIZE_BITS in [1, 12]
+#endif
+
+#if CONNECTION_TRACKER_MAX_PROBES < 1 || CONNECTION_TRACKER_MAX_PROBES > CONNECTION_TRACKER_MAX_NODES
+#error choose CONNECTION_TRACKER_MAX_PROBES in [1, CONNECTION_TRACKER_MAX_NODES]
+#endif
+
 
 void connection_track(int type, uint16_t board_id16, uint16_t epoch);
 void connection_print_and_zero(int type, uint16_t epoch);
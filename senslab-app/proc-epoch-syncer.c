@@ -28,11 +28,15 @@
 #include <assert.h>
 #include "contiki.h"
 #include "net/rime.h"
+#include "lib/list.h"
 #include "util.h"
 #include "proc-list.h"
 #include "radio-arb.h"
 #include "proc-epoch-syncer.h"
 #include "distributions.h"
+#include "sync-time.h"
+#include "profiler.h"
+#include "airtime.h"
 #include "size-estimator-conf.h"
 
 #ifdef XFER_CRC16
@@ -43,6 +47,28 @@
 #endif 
 
 
+/*
+ * The average delay (in kernel ticks) with which the sync packets are
+ * received: when the cxmac RDC is used a sync packet must be re-sent until
+ * the radios of the other nodes are turned on. The measured offsets are
+ * corrected by this delay before being used.
+ */
+/*
+ * A sync packet from more than one epoch ahead gives an offset of whole epoch
+ * intervals. Already two of them make the node end its epoch right away, so
+ * the epoch gap is clamped to EPOCH_SYNC_MAX_EPOCH_GAP: a node rebooted hours
+ * later would otherwise overflow the fine-unit offset (and the offsets sum)
+ */
+#define EPOCH_SYNC_MAX_EPOCH_GAP (2)
+
+
+#if __CONTIKI_NETSTACK_RDC==__CONTIKI_NETSTACK_RDC_NULL
+#define EPOCH_SYNC_TX_DELAY      (0)
+#elif __CONTIKI_NETSTACK_RDC==__CONTIKI_NETSTACK_RDC_CXMAC
+#define EPOCH_SYNC_TX_DELAY      (8)
+#endif
+
+
 /*! 
  * \brief A struct storing the state of the epoch-syncer
  */
@@ -61,10 +87,40 @@ struct epoch_syncer {
 	int32_t epoch_sync_start;
 	int32_t epoch_sync_xfer_interval;
 
-	int32_t sum_sync_offsets;
+	//! The offsets measured in this epoch, in sync time units (see sync-time.h)
+	//  ! the sum is 64bit: up to 2^15 fine-unit offsets of a few epochs each
+	int64_t sum_sync_offsets;
 	int32_t max_offset;
 	int32_t min_offset;
 	int16_t nr_offsets;
+
+	//! A uniform sub-sample of the offsets measured in this epoch (sync time units)
+	int32_t offsets[EPOCH_SYNC_MAX_OFFSETS];
+
+	//! Ring buffers of the (epoch, uncompensated offset) samples used to estimate the skew
+	//  The offsets are in ticks with EPOCH_SKEW_FRAC_BITS fractional bits
+	int16_t skew_epochs[EPOCH_SKEW_WINDOW];
+	int32_t skew_phases[EPOCH_SKEW_WINDOW];
+	uint8_t skew_head;
+	uint8_t skew_nr_samples;
+
+	//! The sum of the epoch timer adjustments applied since the oldest sample in the ring buffers
+	int32_t skew_adjust_sum;
+
+	//! The estimated skew in ticks per epoch (with EPOCH_SKEW_FRAC_BITS fractional bits)
+	int32_t skew;
+
+	//! The fractional part of the skew compensation not yet applied to the epoch timer
+	int32_t skew_remainder;
+
+	//! We send a sync packet only in epochs that are a multiple of this period
+	uint8_t sync_period;
+	uint8_t nr_stable_epochs;
+
+	//! The epoch at whose end we switch to the `run-time` timings
+	int16_t synced_epoch;
+	uint8_t nr_converged_epochs;
+	char synced;
 };
 
 
@@ -84,10 +140,13 @@ struct epoch_sync_packet {
 	//! The sending node current epoch
 	int16_t epoch;
 
-	//! The sending node's time from the start of the current epoch (computed at send time and measedured in kernel ticks)
+	//! The epoch at whose end the sending node will switch to the `run-time` timings
+	int16_t synced_epoch;
+
+	//! The sending node's time from the start of the current epoch (computed at send time and measedured in sync time units)
 	int32_t time_from_epoch_start;
 
-	//! The sending node's time to the end of the current epoch (computed at send time and measedured in kernel ticks)
+	//! The sending node's time to the end of the current epoch (computed at send time and measedured in sync time units)
 	int32_t time_to_epoch_end;
 };
 
@@ -105,12 +164,275 @@ __always_inline__ void epoch_syncer_at_epoch_start(struct epoch_syncer *syncer)
 }
 
 
+/*!
+ * Store the given offset in the offsets buffer.
+ *
+ * ! when the buffer is full we do reservoir sampling: each of the offsets
+ *   measured in this epoch ends up in the buffer with the same probability
+ */
+__always_inline__ void epoch_syncer_add_offset(struct epoch_syncer *syncer, long int offset) {
+	assert(syncer != NULL);
+
+	syncer->max_offset = max(offset, syncer->max_offset);
+	syncer->min_offset = min(offset, syncer->min_offset);
+	syncer->sum_sync_offsets += offset;
+
+	if (syncer->nr_offsets < EPOCH_SYNC_MAX_OFFSETS) {
+		syncer->offsets[syncer->nr_offsets] = offset;
+	} else {
+		unsigned int slot;
+
+		slot = (unsigned)rand() % (unsigned)(syncer->nr_offsets + 1);
+		if (slot < EPOCH_SYNC_MAX_OFFSETS)
+			syncer->offsets[slot] = offset;
+	}
+
+	syncer->nr_offsets++;
+}
+
+
+/*!
+ * Aggregate the offsets measured in this epoch.
+ *
+ * ! there must be at least one offset
+ */
+__always_inline__ long int epoch_syncer_offset_estimate(struct epoch_syncer *syncer) {
+#if EPOCH_SYNC_OFFSET_ESTIMATOR==EPOCH_SYNC_OFFSET_MEAN
+	assert(syncer != NULL);
+	assert(syncer->nr_offsets > 0);
+
+	return (long int)(syncer->sum_sync_offsets / syncer->nr_offsets);
+#else
+	uint8_t i, n;
+	int32_t sorted[EPOCH_SYNC_MAX_OFFSETS];
+
+	assert(syncer != NULL);
+	assert(syncer->nr_offsets > 0);
+
+	/*
+	 * insertion-sort a copy of the buffer: it is short and this is done once or twice per epoch
+	 */
+	n = min(syncer->nr_offsets, (int16_t)EPOCH_SYNC_MAX_OFFSETS);
+	for (i=0; i < n; i++) {
+		int32_t offset;
+		uint8_t j;
+
+		offset = syncer->offsets[i];
+		for (j=i; j > 0 && sorted[j-1] > offset; j--)
+			sorted[j] = sorted[j-1];
+		sorted[j] = offset;
+	}
+
+#if EPOCH_SYNC_OFFSET_ESTIMATOR==EPOCH_SYNC_OFFSET_MEDIAN
+	if (n & 1)
+		return sorted[n/2];
+
+	/*
+	 * ! the midpoint can't overflow this way
+	 */
+	return sorted[n/2 - 1] + (sorted[n/2] - sorted[n/2 - 1])/2;
+#elif EPOCH_SYNC_OFFSET_ESTIMATOR==EPOCH_SYNC_OFFSET_TRIMMED_MEAN
+	{
+		uint8_t trim;
+		int64_t sum;
+
+		trim = n >> EPOCH_SYNC_OFFSET_TRIM_SHIFT;
+		sum = 0;
+		for (i=trim; i < n - trim; i++)
+			sum += sorted[i];
+
+		return (long int)(sum / (n - 2*trim));
+	}
+#else
+#error please configure the offset estimator to be used.
+#endif
+#endif
+}
+
+
+/*!
+ * Forget the skew estimate and restart the regression from scratch.
+ */
+__always_inline__ void epoch_syncer_skew_reset(struct epoch_syncer *syncer) {
+	assert(syncer != NULL);
+
+	syncer->skew_head = 0;
+	syncer->skew_nr_samples = 0;
+	syncer->skew_adjust_sum = 0;
+	syncer->skew = 0;
+	syncer->skew_remainder = 0;
+}
+
+
+/*!
+ * Feed the offset measured in the current epoch (in ticks with
+ * EPOCH_SKEW_FRAC_BITS fractional bits) to the skew estimator.
+ *
+ * The offset measured at the end of epoch e is the sum of the skew
+ * accumulated so far and of all the adjustments we applied to the epoch
+ * timer: removing the latter we get samples that grow linearly with the
+ * epoch index and the slope of the least-squares line trough them is the
+ * skew.
+ */
+__always_inline__ void epoch_syncer_skew_update(struct epoch_syncer *syncer, long int offset) {
+	uint8_t i, oldest;
+	int32_t x0, p0;
+	int32_t sum_x, sum_p, sum_xx, sum_xp;
+	int32_t den;
+	int64_t num;
+
+	assert(syncer != NULL);
+
+	syncer->skew_epochs[syncer->skew_head] = syncer->epoch;
+	syncer->skew_phases[syncer->skew_head] = offset - syncer->skew_adjust_sum * (1 << EPOCH_SKEW_FRAC_BITS);
+	syncer->skew_head = (syncer->skew_head + 1) % EPOCH_SKEW_WINDOW;
+	if (syncer->skew_nr_samples < EPOCH_SKEW_WINDOW) {
+		syncer->skew_nr_samples++;
+	} else {
+		/*
+		 * The window slid: rebase the adjustments sum to zero so that it
+		 * stays bounded. The regression only uses the phase differences,
+		 * shifting all the stored phases by the same amount keeps them
+		 * consistent with the samples to come.
+		 */
+		const int32_t rebase = syncer->skew_adjust_sum * (1 << EPOCH_SKEW_FRAC_BITS);
+
+		for (i=0; i < EPOCH_SKEW_WINDOW; i++)
+			syncer->skew_phases[i] += rebase;
+		syncer->skew_adjust_sum = 0;
+	}
+
+	if (syncer->skew_nr_samples < EPOCH_SKEW_MIN_SAMPLES)
+		return;
+
+	/*
+	 * Work with epochs and offsets relative to the oldest sample: this keeps
+	 * the sums small enough for 32bit arithmetic
+	 */
+	oldest = (syncer->skew_head + EPOCH_SKEW_WINDOW - syncer->skew_nr_samples) % EPOCH_SKEW_WINDOW;
+	x0 = syncer->skew_epochs[oldest];
+	p0 = syncer->skew_phases[oldest];
+
+	sum_x = sum_p = sum_xx = sum_xp = 0;
+	for (i=0; i < syncer->skew_nr_samples; i++) {
+		uint8_t j;
+		int32_t x, p;
+
+		j = (oldest + i) % EPOCH_SKEW_WINDOW;
+		x = syncer->skew_epochs[j] - x0;
+		p = syncer->skew_phases[j] - p0;
+
+		sum_x += x;
+		sum_p += p;
+		sum_xx += x*x;
+		sum_xp += x*p;
+	}
+
+	den = syncer->skew_nr_samples*sum_xx - sum_x*sum_x;
+	if (den <= 0)
+		return;
+
+	num = (int64_t)syncer->skew_nr_samples*sum_xp - (int64_t)sum_x*sum_p;
+	syncer->skew = (int32_t)(num / den);
+}
+
+
+/*!
+ * Return the (integer) number of ticks by which the epoch timer must be
+ * adjusted to pre-compensate the skew in this epoch. The fractional part is
+ * carried over to the next epochs.
+ */
+__always_inline__ long int epoch_syncer_skew_compensation(struct epoch_syncer *syncer) {
+	long int compensation;
+
+	assert(syncer != NULL);
+
+	syncer->skew_remainder -= syncer->skew;
+	compensation = syncer->skew_remainder / (1 << EPOCH_SKEW_FRAC_BITS);
+	syncer->skew_remainder -= compensation * (1 << EPOCH_SKEW_FRAC_BITS);
+
+	return compensation;
+}
+
+
+/*!
+ * Update the sync beacon period given the offset measured in this epoch.
+ */
+__always_inline__ void epoch_syncer_update_sync_period(struct epoch_syncer *syncer, long int offset) {
+	assert(syncer != NULL);
+
+	if ((offset > EPOCH_SYNC_STABLE_OFFSET) || (offset < -EPOCH_SYNC_STABLE_OFFSET)) {
+		syncer->sync_period = 1;
+		syncer->nr_stable_epochs = 0;
+		return;
+	}
+
+	syncer->nr_stable_epochs++;
+	if ((syncer->nr_stable_epochs >= EPOCH_SYNC_STABLE_EPOCHS) && (syncer->sync_period < EPOCH_SYNC_MAX_PERIOD)) {
+		syncer->sync_period <<= 1;
+		syncer->nr_stable_epochs = 0;
+	}
+}
+
+
+/*!
+ * Return non-zero if we have to send a sync packet in the current epoch.
+ */
+__always_inline__ char epoch_syncer_is_sync_epoch(struct epoch_syncer *syncer) {
+	assert(syncer != NULL);
+	assert(syncer->sync_period > 0);
+
+	return (syncer->epoch & (syncer->sync_period - 1)) == 0;
+}
+
+
+/*!
+ * Return non-zero if the offsets measured in the current epoch tell us
+ * that we are synced with our neighbors.
+ *
+ * ! the offsets are corrected by EPOCH_SYNC_TX_DELAY as in the control
+ *   loop: a synced network settles with raw offsets around -tx_delay
+ */
+__always_inline__ char epoch_syncer_offsets_converged(struct epoch_syncer *syncer) {
+	const long int tx_delay = (long int)SYNC_TIME_FROM_CLOCK(EPOCH_SYNC_TX_DELAY);
+
+	assert(syncer != NULL);
+
+	if (!syncer->nr_offsets)
+		return 0;
+
+	return (syncer->max_offset + tx_delay <= (long int)SYNC_TIME_FROM_CLOCK(EPOCH_SYNCED_OFFSET))
+		&& (syncer->min_offset + tx_delay >= -(long int)SYNC_TIME_FROM_CLOCK(EPOCH_SYNCED_OFFSET));
+}
+
+
+/*!
+ * Propose to switch to the `run-time` timings at the given epoch: the
+ * earliest proposal wins.
+ *
+ * ! a proposal for an epoch that has already ended means that our neighbors
+ *   have switched: we switch at the end of the current epoch
+ */
+__always_inline__ void epoch_syncer_propose_synced_epoch(struct epoch_syncer *syncer, int16_t synced_epoch) {
+	assert(syncer != NULL);
+
+	if (syncer->synced)
+		return;
+
+	synced_epoch = max(synced_epoch, (int16_t)EPOCHS_MIN_UNTIL_SYNCED);
+	synced_epoch = max(synced_epoch, syncer->epoch);
+
+	if (synced_epoch < syncer->synced_epoch)
+		syncer->synced_epoch = synced_epoch;
+}
+
+
 /*!
  * Init an epoch-syncer object.
  */
 __always_inline__ void epoch_syncer_init(struct epoch_syncer *syncer) {
 	assert(syncer != NULL);
-	
+
 	syncer->epoch = 0;
 	syncer->epoch_start_time = -1;
 	syncer->epoch_end_time = -1;
@@ -119,13 +441,27 @@ __always_inline__ void epoch_syncer_init(struct epoch_syncer *syncer) {
 	syncer->epoch_interval = EPOCH_INIT_INTERVAL;
 	syncer->epoch_sync_start   = EPOCH_INIT_SYNC_START;
 	syncer->epoch_sync_xfer_interval = EPOCH_INIT_SYNC_XFER_INTERVAL;
+
+	// Send sync packets in every epoch until we are synced
+	syncer->sync_period = 1;
+	syncer->nr_stable_epochs = 0;
+
+	// Switch to the `run-time` timings after EPOCHS_UNTIL_SYNCED epochs at the latest
+	syncer->synced_epoch = EPOCHS_UNTIL_SYNCED;
+	syncer->nr_converged_epochs = 0;
+	syncer->synced = 0;
+
+	epoch_syncer_skew_reset(syncer);
 }
 
 
 /*
- * The two events signalled by the epoch syncer
+ * The events signalled by the epoch syncer
  */
 process_event_t evt_epoch_synced;
+process_event_t evt_epoch_start;
+process_event_t evt_epoch_xfer_open;
+process_event_t evt_epoch_xfer_close;
 process_event_t evt_end_of_epoch;
 
 
@@ -134,6 +470,112 @@ process_event_t evt_end_of_epoch;
  */
 static struct epoch_syncer __epoch_syncer;
 
+#ifdef AIRTIME_ACCOUNTING
+/*
+ * The sync channel airtime counters
+ */
+static struct airtime_counters __sync_airtime;
+#endif
+
+
+/*
+ * The processes subscribed to the epoch phases
+ */
+LIST(__subscriptions);
+
+
+void epoch_syncer_subscribe(struct epoch_subscription *s, struct process *p, uint8_t phase, clock_time_t delay) {
+	assert(s != NULL);
+	assert(p != NULL);
+	assert(phase <= EPOCH_PHASE_END);
+	assert(delay < EPOCH_XFER_INTERVAL);
+
+	s->p = p;
+	s->epoch = -1;
+	s->phase = phase;
+	s->delay = delay;
+	list_add(__subscriptions, s);
+}
+
+
+void epoch_syncer_unsubscribe(struct epoch_subscription *s) {
+	assert(s != NULL);
+
+	ctimer_stop(&s->timer);
+	list_remove(__subscriptions, s);
+}
+
+
+/*!
+ * Return the event signalling the given epoch phase.
+ */
+__always_inline__ process_event_t epoch_syncer_phase_event(uint8_t phase) {
+	switch (phase) {
+	case EPOCH_PHASE_START:
+		return evt_epoch_start;
+	case EPOCH_PHASE_XFER_OPEN:
+		return evt_epoch_xfer_open;
+	case EPOCH_PHASE_XFER_CLOSE:
+		return evt_epoch_xfer_close;
+	default:
+		assert(phase == EPOCH_PHASE_END);
+		return evt_end_of_epoch;
+	}
+}
+
+
+/*!
+ * \brief This callback delivers a phase event to a subscribed process once the
+ * subscription delay has elapsed.
+ */
+static void __subscription_timer_cb(void *ptr) {
+	struct epoch_subscription *s = ptr;
+
+	s->posted = RTIMER_NOW();
+	process_post(s->p, epoch_syncer_phase_event(s->phase), s);
+}
+
+
+/*!
+ * Signal the given phase of the given epoch to the subscribed processes. The
+ * phase starts `time_to_phase` ticks from now.
+ *
+ * ! the ctimers are set from the epoch-syncer process: this must be called
+ *   from its protothread
+ */
+static void epoch_syncer_dispatch(uint8_t phase, int16_t epoch, long int time_to_phase) {
+	struct epoch_subscription *s;
+
+	for (s = list_head(__subscriptions); s != NULL; s = list_item_next(s)) {
+		long int wait;
+
+		if (s->phase != phase)
+			continue;
+
+		s->epoch = epoch;
+		wait = time_to_phase + s->delay;
+		if (wait <= 0) {
+			s->posted = RTIMER_NOW();
+			process_post(s->p, epoch_syncer_phase_event(phase), s);
+		} else
+			ctimer_set(&s->timer, wait, __subscription_timer_cb, s);
+	}
+}
+
+
+/*!
+ * Signal the start of the current epoch and schedule its xfer phases.
+ */
+static void epoch_syncer_dispatch_epoch_start(void) {
+	long int time_to_epoch_end;
+
+	time_to_epoch_end = __epoch_syncer.epoch_end_time - (long int)clock_time();
+
+	epoch_syncer_dispatch(EPOCH_PHASE_START, __epoch_syncer.epoch, 0);
+	epoch_syncer_dispatch(EPOCH_PHASE_XFER_OPEN, __epoch_syncer.epoch, EPOCH_START_DELAY);
+	epoch_syncer_dispatch(EPOCH_PHASE_XFER_CLOSE, __epoch_syncer.epoch, time_to_epoch_end - EPOCH_END_DELAY);
+}
+
 
 /*!
  * \brief This callback notifes us back that the sync-packet
@@ -142,6 +584,8 @@ static struct epoch_syncer __epoch_syncer;
  * after too many retries .
  */
 static void __broadcast_sent_cb(struct broadcast_conn *ptr, int status, int num_tx) {
+	AIRTIME_TX_DONE(&__sync_airtime, status);
+
 	/*
 	 * sync packet sent or dropped: release the radio so that other tasks can use it
 	 */
@@ -150,22 +594,31 @@ static void __broadcast_sent_cb(struct broadcast_conn *ptr, int status, int num_
 
 
 /*!
- *\brief This callback is called by the kernel when a packet is
- * received on the epoch-syncer broadcast channel. In here we compute
- * the time offsets that we use to control the epoch timing, e.g. by
- * delaying or anticipating the next epoch.
+ *\brief This is called when a packet is received on the epoch-syncer
+ * broadcast channel. In here we compute the time offsets that we use to
+ * control the epoch timing, e.g. by delaying or anticipating the next epoch.
  */
-static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
+static void __sync_packet_recv(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
 	int datalen;
 	int distance_nr_epochs;
-	long int now, offset;
+	long int offset;
+	sync_time_t now, epoch_start_time, epoch_end_time;
 	struct epoch_sync_packet packet;
 
 	/*
 	 * Get the current time first-thing; this will be used in the
 	 * computation of the epoch offset
+	 *
+	 * ! when the radio driver timestamps the packets we use the rx time
+	 *   instead, so that the rx queueing delay does not add to the offset
 	 */
-	now = clock_time();
+#ifdef SYNC_MAC_TIMESTAMPS
+	now = sync_time_packet_rx();
+#else
+	now = sync_time_now();
+#endif
+	epoch_start_time = SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_start_time);
+	epoch_end_time = SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_end_time);
 
 	/*
 	 * TODO: we could use the packet rssi to seed tha random number generator
@@ -182,10 +635,12 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 	 */
 
 	datalen = packetbuf_datalen();
+	AIRTIME_RX(&__sync_airtime, datalen);
 	if (datalen != sizeof(struct epoch_sync_packet)) {
 		/*
 		 * xfer corruption; happens rarely.
 		 */
+		AIRTIME_CRC_ERROR(&__sync_airtime);
 		trace("@%d sync xfer corruption, datalen %d\n", __epoch_syncer.epoch, datalen);
 		return;
 	}
@@ -216,6 +671,7 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 			/*
 			 * xfer corruption; happens rarely.
 			 */
+			AIRTIME_CRC_ERROR(&__sync_airtime);
 			trace("@%d sync xfer crc mismatch\n", __epoch_syncer.epoch);
 			return;
 		}
@@ -239,7 +695,8 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		 *
 		 * ! don't trace the sender and return.
 		 */
-		printf("epoch-syncer: discarding packet from epoch %d at epoch %d\n", packet.epoch, __epoch_syncer.epoch);
+		AIRTIME_DISCARD(&__sync_airtime);
+		log_printf("epoch-syncer: discarding packet from epoch %d at epoch %d\n", packet.epoch, __epoch_syncer.epoch);
 		return;
 	} else if (distance_nr_epochs < 0) {
 		long int time_to_epoch_end;
@@ -247,11 +704,14 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		 * We are going too slow !
 		 */
 		if (distance_nr_epochs == -1) {
-			assert(__epoch_syncer.epoch_end_time > now);
-			time_to_epoch_end = (long int)__epoch_syncer.epoch_end_time - now;
+			time_to_epoch_end = (long int)(epoch_end_time - now);
+			assert(time_to_epoch_end > 0);
 			offset = time_to_epoch_end + packet.time_from_epoch_start;
 		} else {
-			offset = __epoch_syncer.epoch_interval*(packet.epoch - __epoch_syncer.epoch);
+			/*
+			 * ! the gap is clamped, see EPOCH_SYNC_MAX_EPOCH_GAP
+			 */
+			offset = SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_interval)*min(-distance_nr_epochs, EPOCH_SYNC_MAX_EPOCH_GAP);
 		}
 	} else {
 		long int time_from_epoch_start, time_to_epoch_end;
@@ -259,7 +719,7 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		/* 
 		 * Both this node and the sender node are in the same epoch.
 		 */
-		if (now > __epoch_syncer.epoch_end_time) {
+		if ((long int)(now - epoch_end_time) > 0) {
 			/*
 			 * The epoch is expired but the epoch counter has not been updated yet.
 			 * If this happens there is a *bug*: something is delaying the epoch_timer `is-expired`
@@ -267,21 +727,30 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 			 *
 			 * ! we can't and don't want to recover from this situation: go fix your changes in the code :)
 			 */
-			printf("@%d BUG epoch-syncer: packet received after end-of-epoch %ld\n", __epoch_syncer.epoch, now - (long int)__epoch_syncer.epoch_end_time);
+			AIRTIME_DISCARD(&__sync_airtime);
+			log_printf("@%d BUG epoch-syncer: packet received after end-of-epoch %ld\n", __epoch_syncer.epoch, sync_time_to_clock((long int)(now - epoch_end_time)));
 			return;
 		}
 
 		/*
 		 * compute this node's `time from epoch start` and `time to epoch end`
 		 */
-		assert(now <= __epoch_syncer.epoch_end_time);
-		assert(__epoch_syncer.epoch_start_time <= now);
 		assert(__epoch_syncer.epoch_end_time >__epoch_syncer.epoch_start_time);
-		time_from_epoch_start = now - __epoch_syncer.epoch_start_time;
+		time_from_epoch_start = (long int)(now - epoch_start_time);
+		time_to_epoch_end = (long int)(epoch_end_time - now);
 
-		assert(time_from_epoch_start >= 0);
-		assert(time_from_epoch_start < (__epoch_syncer.epoch_end_time -__epoch_syncer.epoch_start_time));
-		time_to_epoch_end = __epoch_syncer.epoch_end_time - now;
+		if (time_from_epoch_start <= 0) {
+			/*
+			 * The packet was stamped before our epoch start (or at the very same
+			 * time) and we can't interpolate the offset: drop it
+			 *
+			 * ! this can happen only with driver timestamps or with the fine clock
+			 *   when the epoch start time is rounded down to the kernel tick
+			 */
+			trace("@%d sync packet received at epoch start\n", __epoch_syncer.epoch);
+			return;
+		}
+		assert(time_to_epoch_end >= 0);
 
 		/*
 		 * compute the `time to epoch end` offset between this node and the sender node
@@ -290,20 +759,23 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 
 		/*
 		 * linearly interpolate to guess the eventual offset at end of this node epoch
+		 *
+		 * ! in sync time units the product doesn't fit in 32 bits
 		 */
-		offset = (offset*__epoch_syncer.epoch_interval)/time_from_epoch_start;
+		offset = (long int)(((int64_t)offset*SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_interval))/time_from_epoch_start);
 	}
 
-	/* update offset statistics */
-	__epoch_syncer.max_offset = max(offset, __epoch_syncer.max_offset);
-	__epoch_syncer.min_offset = min(offset, __epoch_syncer.min_offset);
+	/*
+	 * Adopt the sender proposal for the switch to the `run-time` timings
+	 * if it comes earlier than ours
+	 */
+	epoch_syncer_propose_synced_epoch(&__epoch_syncer, packet.synced_epoch);
 
 	/*
-	 * Accumulate the offsets: from this sum the `offset-average` can be computed.
-	 * This average is then used to adjust the timing of the next epoch.
+	 * Store the offset: at the end of the epoch all the stored offsets are aggregated
+	 * and the result is used to adjust the timing of the next epoch.
 	 */
-	__epoch_syncer.sum_sync_offsets += offset;
-	__epoch_syncer.nr_offsets++;
+	epoch_syncer_add_offset(&__epoch_syncer, offset);
 
 #ifdef TRACK_CONNECTIONS
 	/* trace the xfer */
@@ -312,6 +784,17 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 }
 
 
+/*!
+ *\brief This callback is called by the kernel when a packet is
+ * received on the epoch-syncer broadcast channel.
+ */
+static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
+	PROFILER_START(PROF_SYNC_RECV);
+	__sync_packet_recv(ptr, sender);
+	PROFILER_STOP(PROF_SYNC_RECV);
+}
+
+
 
 PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 	static struct etimer send_timer;
@@ -335,9 +818,12 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 	printf("epoch interval %ld ticks\n", EPOCH_INTERVAL);
 
 	/*
-	 * Alloc the two syncer events
+	 * Alloc the syncer events
 	 */
 	evt_epoch_synced = process_alloc_event();
+	evt_epoch_start = process_alloc_event();
+	evt_epoch_xfer_open = process_alloc_event();
+	evt_epoch_xfer_close = process_alloc_event();
 	evt_end_of_epoch = process_alloc_event();
 
 	/*
@@ -382,8 +868,14 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 		 * ! we cannot let send_timer delay the epoch_timer, especially
 		 *   when the next `end-of-epoch-time` has been anticipated by a lot
 		 *   (this can happen at startup)
+		 *
+		 * ! when the offsets are stable we don't send sync packets in every epoch
 		 */
-		if (time_to_epoch_end > __epoch_syncer.epoch_sync_start) {
+		if (!epoch_syncer_is_sync_epoch(&__epoch_syncer)) {
+			/*
+			 * the skew compensation keeps us synced in this epoch
+			 */
+		} else if (time_to_epoch_end > __epoch_syncer.epoch_sync_start) {
 			long int send_wait;
 			long int send_wait_rnd;
 			long int rnd;
@@ -401,6 +893,7 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 			etimer_set(&send_timer, send_wait);
 
 			PROCESS_WAIT_UNTIL(etimer_expired(&send_timer));
+			PROFILER_RECORD(PROF_SYNC_SEND_SLIP, sync_time_to_rtimer((long int)(sync_time_now() - SYNC_TIME_FROM_CLOCK(etimer_expiration_time(&send_timer)))));
 
 			/*
 			 * Acquire the radio lock
@@ -409,16 +902,18 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 			 *   1) we do not want to yield if we can acquire the lock on the first try
 			 *   2) no kernel signal is generated when the lock is released (we would `deadlock')
 			 */
+			PROFILER_START(PROF_SYNC_RADIO_LOCK);
 			do {
 				if (!radio_trylock())
 					break;
 
 				PROCESS_PAUSE();
 			} while (1);
+			PROFILER_STOP(PROF_SYNC_RADIO_LOCK);
 
 
 			{
-				clock_time_t now;
+				sync_time_t now;
 				struct epoch_sync_packet packet;
 					
 				/*
@@ -432,12 +927,17 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 				packet.board_id16 = board_get_id16();
 #endif
 				packet.epoch = __epoch_syncer.epoch;
+				packet.synced_epoch = __epoch_syncer.synced_epoch;
 
-				now = clock_time();
-				assert(now > __epoch_syncer.epoch_start_time);
-				assert(__epoch_syncer.epoch_end_time > now);
-				packet.time_from_epoch_start = now - __epoch_syncer.epoch_start_time;
-				packet.time_to_epoch_end = __epoch_syncer.epoch_end_time - now;
+				/*
+				 * ! the packet is stamped as late as possible: the radio lock is held
+				 *   and no other packet can delay its transmission
+				 */
+				now = sync_time_now();
+				packet.time_from_epoch_start = (int32_t)(now - SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_start_time));
+				packet.time_to_epoch_end = (int32_t)(SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_end_time) - now);
+				assert(packet.time_from_epoch_start > 0);
+				assert(packet.time_to_epoch_end > 0);
 
 				
 #ifdef XFER_CRC16
@@ -454,10 +954,11 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 				}
 #endif
 				packetbuf_copyfrom(&packet, sizeof(struct epoch_sync_packet));
+				AIRTIME_TX_START(&__sync_airtime, sizeof(struct epoch_sync_packet));
 				broadcast_send(&conn);
 			}
 		} else {
-			printf("epoch-syncer: skipping sync send\n");
+			log_printf("epoch-syncer: skipping sync send\n");
 		}
 			
 
@@ -465,22 +966,23 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 		 * We cannot YIELD here: if epoch_timer has already expired there won't be
 		 * any event to wake us up.
 		 *
-		 * FIXME: if we get here and the epoch timer has fired
-		 * already print by how much we are late: this can be terribly useful
-		 * to trace bugs in the epoch sync code or the kernel.
+		 * If the epoch timer has fired already print by how much we are late:
+		 * this can be terribly useful to trace bugs in the epoch sync code or
+		 * the kernel.
 		 */
 		if (etimer_expired(&epoch_timer)) {
-			long int now;
+			long int late;
 
-			now = clock_time();
-			assert(now > __epoch_syncer.epoch_end_time);
-			
+			late = (long int)(sync_time_now() - SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_end_time));
+			assert(late >= 0);
+			log_printf("@%d epoch-syncer: late for end-of-epoch by %ld ticks\n", __epoch_syncer.epoch, sync_time_to_clock(late));
+			PROFILER_RECORD(PROF_EPOCH_END_LATENESS, sync_time_to_rtimer(late));
 		} else {
 			char do_wait;
 			do_wait = 1;
 
-			if (__epoch_syncer.sum_sync_offsets) {
-				long int avg_offset = __epoch_syncer.sum_sync_offsets / __epoch_syncer.nr_offsets;
+			if (__epoch_syncer.nr_offsets) {
+				long int avg_offset = sync_time_to_clock(epoch_syncer_offset_estimate(&__epoch_syncer));
 				const long int threshold = CLOCK_SECOND;
 
 				if (avg_offset > threshold) {
@@ -514,6 +1016,7 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 
 			if (do_wait) {
 				PROCESS_WAIT_UNTIL(etimer_expired(&epoch_timer));
+				PROFILER_RECORD(PROF_EPOCH_END_LATENESS, sync_time_to_rtimer((long int)(sync_time_now() - SYNC_TIME_FROM_CLOCK(__epoch_syncer.epoch_end_time))));
 			} else {
 				trace("epoch-syncer: not waiting for end-of-epoch\n");
 			}
@@ -523,17 +1026,34 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 #ifdef TRACK_CONNECTIONS
 		connection_print_and_zero(CONNECTION_TRACK_SYNC, __epoch_syncer.epoch);
 #endif
+		PROFILER_PRINT_AND_ZERO(__epoch_syncer.epoch);
+		AIRTIME_PRINT_AND_ZERO(&__sync_airtime, "sync", __epoch_syncer.epoch);
+		AIRTIME_PRINT_ENERGEST(__epoch_syncer.epoch);
+
+		/*
+		 * While syncing, check if the offsets converged and eventually propose
+		 * a switch to the `run-time` timings to our neighbors
+		 */
+		if (!__epoch_syncer.synced) {
+			if (epoch_syncer_offsets_converged(&__epoch_syncer))
+				__epoch_syncer.nr_converged_epochs++;
+			else
+				__epoch_syncer.nr_converged_epochs = 0;
+
+			if (__epoch_syncer.nr_converged_epochs >= EPOCH_SYNCED_NR_EPOCHS)
+				epoch_syncer_propose_synced_epoch(&__epoch_syncer, __epoch_syncer.epoch + EPOCH_SYNCED_LEAD);
+		}
 
 		/*
 		 * Re-Set the end-of-epoch timer
 		 */
-		if (__epoch_syncer.epoch == EPOCHS_UNTIL_SYNCED) {
+		if (!__epoch_syncer.synced && (__epoch_syncer.epoch == __epoch_syncer.synced_epoch)) {
 			/*
 			 * We have hopefully achieved sync at this point
 			 *
 			 * 1) update the epoch timings, and set the epoch timer
 			 *
-			 * 2) signal the size-estimator process that the epoch is now synced
+			 * 2) signal the subscribed processes that the epoch is now synced
 			 */
 			__epoch_syncer.epoch_interval = EPOCH_INTERVAL;
 			__epoch_syncer.epoch_sync_start = EPOCH_SYNC_START;
@@ -550,7 +1070,36 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 			__epoch_syncer.epoch_end_time = etimer_expiration_time(&epoch_timer);
 			__epoch_syncer.epoch++;
 
-			process_post(&proc_size_estimator, evt_epoch_synced, NULL);
+			/*
+			 * The epoch timer has been restarted from scratch: the offsets measured
+			 * so far can't be used to estimate the skew anymore
+			 */
+			epoch_syncer_skew_reset(&__epoch_syncer);
+
+			/*
+			 * Log when we got synced: the time from reset to the first estimate
+			 * is tracked at post-processing time
+			 */
+			__epoch_syncer.synced = 1;
+			log_printf("epoch-syncer: synced at epoch %d after %ld ticks\n", __epoch_syncer.synced_epoch, (long int)clock_time());
+
+			{
+				struct epoch_subscription *s, *t;
+
+				/*
+				 * ! post the event once per process
+				 */
+				for (s = list_head(__subscriptions); s != NULL; s = list_item_next(s)) {
+					for (t = list_head(__subscriptions); t != s; t = list_item_next(t)) {
+						if (t->p == s->p)
+							break;
+					}
+					if (t == s)
+						process_post(s->p, evt_epoch_synced, &__epoch_syncer.synced_epoch);
+				}
+			}
+
+			epoch_syncer_dispatch_epoch_start();
 		} else {
 			/*
 			 * Re-set and adjust the epoch timer using the data received trough sync packets
@@ -570,53 +1119,73 @@ PROCESS_THREAD(proc_epoch_syncer, ev, data) {
 			__epoch_syncer.epoch_start_time = clock_time();
 			__epoch_syncer.epoch_end_time = etimer_expiration_time(&epoch_timer);
 			__epoch_syncer.epoch++;
-			if (__epoch_syncer.sum_sync_offsets) {
-				long int avg_offset = __epoch_syncer.sum_sync_offsets / __epoch_syncer.nr_offsets;
-				const long int threshold = 1;//(CLOCK_SECOND/32);//*3;
+			{
+				const long int adjust_threshold = CLOCK_SECOND/2;
+				long int adjust;
 
-#if __CONTIKI_NETSTACK_RDC==__CONTIKI_NETSTACK_RDC_NULL
-				const int tx_delay = 0;
-#elif __CONTIKI_NETSTACK_RDC==__CONTIKI_NETSTACK_RDC_CXMAC
 				/*
-				 * When the cxmac RDC is used we must consider an added delay due to the fact that when
-				 * other nodes radios are turned off the sync packet must be re-sent.
+				 * pre-compensate the estimated skew: this is done in every epoch,
+				 * also when no sync packets were received
 				 */
-				const int tx_delay = 8;
-#endif
+				adjust = epoch_syncer_skew_compensation(&__epoch_syncer);
 
-				/*
-				 * estimate the avg tx delay
-				 */
-				avg_offset += tx_delay;
+				if (__epoch_syncer.nr_offsets) {
+					long int fine_offset = epoch_syncer_offset_estimate(&__epoch_syncer);
+					long int avg_offset = sync_time_to_clock(fine_offset);
+					const long int threshold = 1;//(CLOCK_SECOND/32);//*3;
 
-				trace("epoch-syncer: sync offsets %d ~ %ld < %ld < %ld\n", __epoch_syncer.nr_offsets,  __epoch_syncer.min_offset + tx_delay, avg_offset, __epoch_syncer.max_offset+tx_delay);
-				
-				if ((avg_offset < -threshold) || (avg_offset > threshold)) {
-					clock_time_t new_expiration_time;
+					const int tx_delay = EPOCH_SYNC_TX_DELAY;
 
-					const long int adjust_threshold = CLOCK_SECOND/2;
-					long int adjust;
-		
 					/*
-					 * feedback control the next expiration time
+					 * estimate the avg tx delay
 					 */
-					adjust = -avg_offset/2;
-					adjust = min(adjust, adjust_threshold);
-					adjust = max(adjust, -adjust_threshold);
-
-					if (adjust)
-						etimer_adjust(&epoch_timer, adjust);
-						
-					new_expiration_time = etimer_expiration_time(&epoch_timer);
-					__epoch_syncer.epoch_end_time = new_expiration_time;
+					avg_offset += tx_delay;
+
+					trace("epoch-syncer: sync offsets %d ~ %ld < %ld < %ld\n", __epoch_syncer.nr_offsets,  sync_time_to_clock(__epoch_syncer.min_offset) + tx_delay, avg_offset, sync_time_to_clock(__epoch_syncer.max_offset) + tx_delay);
+
+					/*
+					 * the offset is the residual error left by the skew compensation
+					 */
+					if ((avg_offset > EPOCH_SKEW_MAX_OFFSET) || (avg_offset < -EPOCH_SKEW_MAX_OFFSET)) {
+						epoch_syncer_skew_reset(&__epoch_syncer);
+						adjust = 0;
+					} else {
+						/*
+						 * ! feed the skew estimator with the sub-tick offset
+						 */
+						epoch_syncer_skew_update(&__epoch_syncer, sync_time_to_fixpoint(fine_offset, EPOCH_SKEW_FRAC_BITS) + (long int)tx_delay * (1 << EPOCH_SKEW_FRAC_BITS));
+					}
+
+					if (__epoch_syncer.synced)
+						epoch_syncer_update_sync_period(&__epoch_syncer, avg_offset);
+
+					if ((avg_offset < -threshold) || (avg_offset > threshold)) {
+						/*
+						 * feedback control the next expiration time
+						 */
+						adjust += -avg_offset/2;
+					}
 				}
+
+				adjust = min(adjust, adjust_threshold);
+				adjust = max(adjust, -adjust_threshold);
+
+				if (adjust) {
+					etimer_adjust(&epoch_timer, adjust);
+					__epoch_syncer.epoch_end_time = etimer_expiration_time(&epoch_timer);
+				}
+				__epoch_syncer.skew_adjust_sum += adjust;
+
+				trace("epoch-syncer: skew %ld/%d ticks, sync period %d\n", (long int)__epoch_syncer.skew, 1 << EPOCH_SKEW_FRAC_BITS, __epoch_syncer.sync_period);
 			}
 
-			if (__epoch_syncer.epoch > EPOCHS_UNTIL_SYNCED) {
+			if (__epoch_syncer.synced) {
 				/*
-				 * Signal the estimator-process that this epoch has ended
+				 * Signal the subscribed processes that the previous epoch has ended
+				 * and that a new one has started
 				 */
-				process_post(&proc_size_estimator, evt_end_of_epoch, NULL);
+				epoch_syncer_dispatch(EPOCH_PHASE_END, __epoch_syncer.epoch - 1, 0);
+				epoch_syncer_dispatch_epoch_start();
 			}
 		}
 	}
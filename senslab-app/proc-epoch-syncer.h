@@ -29,18 +29,23 @@
 
 
 /**
- * The epoch-syncer can posts two type of events
+ * The epoch-syncer posts two kinds of events to the subscribed processes (see below)
  *
  * - the first one is used to tell consumer processes tha the epoch synchro is now stable
  *   troughout the network. This event is signalled only once at startup as soon as the
  *   epoch-syncer has achieved sufficient syncronization between the nodes.
  *   The size estimator process will start running its algo only aftert this event has
- *   been signalled.
+ *   been signalled. The event data points to the (int16_t) index of the epoch at which
+ *   the network got synced.
  *
- * - the second one is used to signal the end of an epoch: the size estimator process
- *   uses this event to sync its internal logic.
+ * - the others signal the epoch phases: the size estimator process uses the end of
+ *   epoch event to sync its internal logic. The event data points to the
+ *   subscription, whose .epoch field holds the index of the signalled epoch.
  */
 extern process_event_t evt_epoch_synced;
+extern process_event_t evt_epoch_start;
+extern process_event_t evt_epoch_xfer_open;
+extern process_event_t evt_epoch_xfer_close;
 extern process_event_t evt_end_of_epoch;
 
 
@@ -72,12 +77,89 @@ extern process_event_t evt_end_of_epoch;
 
 
 /*
- * The number of epochs from startup that are necessary for all nodes to be synced
+ * Epoch phases
+ *
+ * A process subscribes to an epoch phase with epoch_syncer_subscribe(): once the
+ * network is synced it receives the phase event `delay` ticks after the phase
+ * time, in every epoch
+ *
+ * - EPOCH_PHASE_START, at `ts`, evt_epoch_start
+ * - EPOCH_PHASE_XFER_OPEN, at `td1`, evt_epoch_xfer_open
+ * - EPOCH_PHASE_XFER_CLOSE, at `td2`, evt_epoch_xfer_close
+ * - EPOCH_PHASE_END, at `te`, evt_end_of_epoch
+ *
+ * All subscribed processes also receive evt_epoch_synced.
+ *
+ * ! the subscription struct must stay allocated (static) until unsubscribed
+ *
+ * ! a subscription has a single timer: the delay must be shorter than the
+ *   time to the same phase in the next epoch, EPOCH_XFER_INTERVAL at most
+ */
+#define EPOCH_PHASE_START        0
+#define EPOCH_PHASE_XFER_OPEN    1
+#define EPOCH_PHASE_XFER_CLOSE   2
+#define EPOCH_PHASE_END          3
+
+struct epoch_subscription {
+	//! Subscriptions are kept in a Contiki list: this must be the first member
+	struct epoch_subscription *next;
+
+	//! The subscribed process
+	struct process *p;
+
+	//! The index of the signalled epoch, valid when the event is received
+	int16_t epoch;
+
+	uint8_t phase;
+	clock_time_t delay;
+
+	//! The timer used to deliver the event `delay` ticks after the phase
+	struct ctimer timer;
+
+	//! The rtimer time at which the last event was posted
+	rtimer_clock_t posted;
+};
+
+void epoch_syncer_subscribe(struct epoch_subscription *s, struct process *p, uint8_t phase, clock_time_t delay);
+void epoch_syncer_unsubscribe(struct epoch_subscription *s);
+
+
+/*
+ * The maximum number of epochs from startup that are necessary for all nodes to be synced
+ *
+ * ! nodes usually switch to the `run-time` timings much earlier, see below
  */
 #define EPOCHS_UNTIL_SYNCED      (10)
 
 /*
- * Epoch timings to be used from reset until EPOCHS_UNTIL_SYNCED epochs elapsed
+ * Adaptive sync convergence
+ *
+ * A node considers itself synced after the offsets measured in
+ * EPOCH_SYNCED_NR_EPOCHS consecutive epochs all stayed within
+ * EPOCH_SYNCED_OFFSET ticks. It then proposes to switch to the `run-time`
+ * timings EPOCH_SYNCED_LEAD epochs later. The proposal travels in the sync
+ * packets and every node adopts the earliest switch epoch it hears of, so
+ * that the whole network switches at the same epoch.
+ *
+ * The proposal moves one hop per epoch: the lead is the network diameter
+ * (in hops) EPOCH_SYNC_NETWORK_DIAMETER, so that it reaches every node in
+ * time. A node that hears of a switch epoch already past (the network is
+ * wider than configured) switches at the end of its current epoch.
+ *
+ * ! nodes never switch before EPOCHS_MIN_UNTIL_SYNCED nor after EPOCHS_UNTIL_SYNCED
+ */
+#define EPOCHS_MIN_UNTIL_SYNCED  (3)
+#define EPOCH_SYNCED_OFFSET      (CLOCK_SECOND/16)
+#define EPOCH_SYNCED_NR_EPOCHS   (2)
+#define EPOCH_SYNC_NETWORK_DIAMETER (5)
+#define EPOCH_SYNCED_LEAD        (EPOCH_SYNC_NETWORK_DIAMETER)
+
+#if EPOCHS_MIN_UNTIL_SYNCED + EPOCH_SYNCED_LEAD > EPOCHS_UNTIL_SYNCED
+#error the switch lead leaves no room for an early switch, increase EPOCHS_UNTIL_SYNCED
+#endif
+
+/*
+ * Epoch timings to be used from reset until the nodes are synced
  */
 #define EPOCH_INIT_INTERVAL           (CLOCK_SECOND*10)
 #define EPOCH_INIT_SYNC_START         (CLOCK_SECOND*4)
@@ -98,6 +180,68 @@ extern process_event_t evt_end_of_epoch;
 #define EPOCH_XFER_INTERVAL      (EPOCH_INTERVAL - EPOCH_START_DELAY - EPOCH_END_DELAY)
 
 
+/*
+ * Offset aggregation
+ *
+ * The offsets measured in each epoch are stored in a buffer of
+ * EPOCH_SYNC_MAX_OFFSETS entries (when more packets are received a uniform
+ * sub-sample is kept) and aggregated at the epoch end with one of the
+ * following estimators
+ *
+ * - EPOCH_SYNC_OFFSET_MEAN, the plain average of all offsets
+ * - EPOCH_SYNC_OFFSET_MEDIAN, the median of the buffered offsets
+ * - EPOCH_SYNC_OFFSET_TRIMMED_MEAN, the average of the buffered offsets
+ *   after discarding the lowest and highest 1/2^EPOCH_SYNC_OFFSET_TRIM_SHIFT
+ *   of them
+ *
+ * ! the median and the trimmed mean are robust to the few badly out-of-sync
+ *   neighbors that otherwise drag the plain average. The plain average stays
+ *   the default until the robust estimators have been compared with it on
+ *   real runs
+ */
+#define EPOCH_SYNC_OFFSET_MEAN         0
+#define EPOCH_SYNC_OFFSET_MEDIAN       1
+#define EPOCH_SYNC_OFFSET_TRIMMED_MEAN 2
+
+#define EPOCH_SYNC_OFFSET_ESTIMATOR    EPOCH_SYNC_OFFSET_MEAN
+#define EPOCH_SYNC_OFFSET_TRIM_SHIFT   (2)
+#define EPOCH_SYNC_MAX_OFFSETS         (16)
+
+
+/*
+ * Clock-skew estimation
+ *
+ * Each node estimates the rate at which its epoch drifts wrt its neighbors
+ * by a linear regression over the last EPOCH_SKEW_WINDOW measured offsets
+ * (after removing the corrections already applied). The estimate, in kernel
+ * ticks per epoch with EPOCH_SKEW_FRAC_BITS fractional bits, is used to
+ * pre-compensate the epoch timer at every epoch end.
+ *
+ * ! the regression is restarted whenever the measured offset exceeds
+ *   EPOCH_SKEW_MAX_OFFSET: we are not in the `fine-tuning` regime anymore
+ */
+#define EPOCH_SKEW_WINDOW        (8)
+#define EPOCH_SKEW_MIN_SAMPLES   (3)
+#define EPOCH_SKEW_FRAC_BITS     (8)
+#define EPOCH_SKEW_MAX_OFFSET    (CLOCK_SECOND/8)
+
+
+/*
+ * Sync beacon rate
+ *
+ * Once the average offset stays within EPOCH_SYNC_STABLE_OFFSET ticks for
+ * EPOCH_SYNC_STABLE_EPOCHS consecutive epochs a node halves its sync beacon
+ * rate, down to one beacon every EPOCH_SYNC_MAX_PERIOD epochs. The full rate
+ * is restored as soon as the offset leaves the threshold.
+ *
+ * ! the period must be a power of two: all nodes then beacon in the epochs
+ *   that are multiples of the largest period in use
+ */
+#define EPOCH_SYNC_STABLE_OFFSET (2)
+#define EPOCH_SYNC_STABLE_EPOCHS (4)
+#define EPOCH_SYNC_MAX_PERIOD    (4)
+
+
 /*
  * Sanity checks
  */
@@ -126,6 +270,22 @@ extern process_event_t evt_end_of_epoch;
 #error choose a longer EPOCH_INTERVAL.
 #endif
 
+#if EPOCH_SYNC_MAX_OFFSETS < 1 || EPOCH_SYNC_MAX_OFFSETS > 255
+#error choose EPOCH_SYNC_MAX_OFFSETS in [1, 255]
+#endif
+
+#if EPOCHS_MIN_UNTIL_SYNCED < 1 || EPOCHS_MIN_UNTIL_SYNCED > EPOCHS_UNTIL_SYNCED
+#error choose EPOCHS_MIN_UNTIL_SYNCED in [1, EPOCHS_UNTIL_SYNCED]
+#endif
+
+#if EPOCH_SKEW_MIN_SAMPLES < 2 || EPOCH_SKEW_MIN_SAMPLES > EPOCH_SKEW_WINDOW
+#error choose EPOCH_SKEW_MIN_SAMPLES in [2, EPOCH_SKEW_WINDOW]
+#endif
+
+#if EPOCH_SYNC_MAX_PERIOD & (EPOCH_SYNC_MAX_PERIOD - 1)
+#error EPOCH_SYNC_MAX_PERIOD must be a power of two
+#endif
+
 
 #endif /* __PROC_EPOCH_SYNCER_H__ */
 
@@ -35,6 +35,9 @@
  */
 PROCESS_NAME(proc_epoch_syncer);
 PROCESS_NAME(proc_size_estimator);
+#ifdef LOG_DEFERRED
+PROCESS_NAME(proc_log_drainer);
+#endif
 
 #endif /* __PROC_LIST_H__ */
 
@@ -33,6 +33,8 @@
 #include "proc-epoch-syncer.h"
 #include "size-estimators/uniform/uni-size-estimator.h"
 #include "distributions.h"
+#include "profiler.h"
+#include "airtime.h"
 #include "size-estimator-conf.h"
 #ifdef XFER_CRC16
 #include "crc16.h"
@@ -98,12 +100,26 @@ static process_event_t evt_consensus_packet_sent;
  */
 static struct uniform_size_estimator __size_estimator;
 
+/*
+ * Our subscription to the end of epoch event
+ */
+static struct epoch_subscription __end_of_epoch_subscription;
+
+#ifdef AIRTIME_ACCOUNTING
+/*
+ * The consensus channel airtime counters
+ */
+static struct airtime_counters __data_airtime;
+#endif
+
 /*!
  * \brief This callback notifes us back that the consensus-packet transmission has come to completion:
  * either it was successful or the packet has been dropped after too many retries (assuming
  * the csma MAC layer is in use).
  */
 static void __broadcast_sent_cb(struct broadcast_conn *ptr, int status, int num_tx) {
+	AIRTIME_TX_DONE(&__data_airtime, status);
+
 	/*
 	 * signal back the estimator process that the latest queued packet has been sent
 	 */
@@ -119,7 +135,7 @@ static void __broadcast_sent_cb(struct broadcast_conn *ptr, int status, int num_
 #error please make PAKCET_SPLITTER_PAYLOAD_LEN a multiple of 2
 #endif
 
-static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
+static void __consensus_packet_recv(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
 	uint16_t i;
 	uint16_t datalen;
 	fractional16_t *localdata_cur;
@@ -129,6 +145,8 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 	struct split_packet_hdr packet_hdr;
 	struct split_packet *packet;
 
+	AIRTIME_RX(&__data_airtime, packetbuf_datalen());
+
 	if (!uni_size_estimator_enabled(&__size_estimator))
 		return;
 
@@ -143,6 +161,7 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		/*
 		 * xfer corruption; happens rarely.
 		 */
+		AIRTIME_CRC_ERROR(&__data_airtime);
 		trace("@%d data xfer corruption, datalen %d\n", __size_estimator.epoch, datalen);
 		return;
 	}
@@ -166,7 +185,8 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		crc16 = crc16_data((const unsigned char *)packet, datalen, 0);
 
 		if (packet_hdr.crc16 != crc16) {
-			printf("@%d data xfer crc mismatch\n", __size_estimator.epoch);
+			AIRTIME_CRC_ERROR(&__data_airtime);
+			log_printf("@%d data xfer crc mismatch\n", __size_estimator.epoch);
 			return;
 		}
 	}
@@ -176,7 +196,8 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 		/*
 		 * We can't use this packet, log and return.
 		 */
-		printf("size-estimator: discard packet from epoch %d at epoch %d\n", packet_hdr.epoch, __size_estimator.epoch);
+		AIRTIME_DISCARD(&__data_airtime);
+		log_printf("size-estimator: discard packet from epoch %d at epoch %d\n", packet_hdr.epoch, __size_estimator.epoch);
 		return;
 	}
 
@@ -187,7 +208,7 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 	 */
 	payload_cur = (fractional16_t *)&(packet->data[0]);
 	if ((int)payload_cur & 1) {
-		printf("size-estimator: uff payload is mis-aligned\n");
+		log_printf("size-estimator: uff payload is mis-aligned\n");
 		memcpy(payload, &packet->data, packet_hdr.payloadlen);
 		payload_cur = payload;
 	}
@@ -218,6 +239,13 @@ static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *se
 }
 
 
+static void __broadcast_recv_cb(struct broadcast_conn *ptr, const rimeaddr_t *sender) {
+	PROFILER_START(PROF_DATA_RECV);
+	__consensus_packet_recv(ptr, sender);
+	PROFILER_STOP(PROF_DATA_RECV);
+}
+
+
 
 PROCESS_THREAD(proc_size_estimator, ev, data) {
 	static struct etimer send_timer;
@@ -265,7 +293,6 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 	 * Init the size-estimator object
 	 */
 	uni_size_estimator_init(&__size_estimator);
-	uni_size_estimator_jump_to_epoch(&__size_estimator, EPOCHS_UNTIL_SYNCED);
 
 	/*
 	 * Allocate the `consensus packet sent` event
@@ -278,10 +305,18 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 	broadcast_open(&conn, BROADCAST_CHANNEL_ESTIMATOR, &broadcast_cbs);
 
 	/*
-	 * Now wait until the epoch syncer gives us the `start`
+	 * Subscribe to the end of epoch event and wait until the epoch syncer
+	 * gives us the `start`
 	 */
+	epoch_syncer_subscribe(&__end_of_epoch_subscription, &proc_size_estimator, EPOCH_PHASE_END, 0);
 	PROCESS_WAIT_EVENT_UNTIL(ev == evt_epoch_synced);
 
+	/*
+	 * The epoch-syncer tells us at which epoch the network got synced
+	 */
+	assert(data != NULL);
+	uni_size_estimator_jump_to_epoch(&__size_estimator, *(int16_t *)data);
+
 	/*
 	 * Enter the main estimator loop
 	 */
@@ -463,12 +498,14 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 			 *   1) we do not want to yield if we can acquire the lock on the first try
 			 *   2) no kernel signal is generated when the lock is released (we would `deadlock')
 			 */
+			PROFILER_START(PROF_DATA_RADIO_LOCK);
 			do {
 				if (!radio_trylock())
 					break;
 
 				PROCESS_PAUSE();
 			} while (1);
+			PROFILER_STOP(PROF_DATA_RADIO_LOCK);
 
 			/* 
 			 * Transmit consensus data
@@ -482,7 +519,10 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 				/*
 				 * Prepare and send a new consensus packet.
 				 */
+				PROFILER_START(PROF_QUEUE_PACKET);
 				bytes_remaining = uni_size_estimator_queue_packet(&__size_estimator);
+				PROFILER_STOP(PROF_QUEUE_PACKET);
+				AIRTIME_TX_START(&__data_airtime, packetbuf_datalen());
 				broadcast_send(&conn);
 
 				/*
@@ -502,7 +542,7 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 					/*
 					 * bail, we are already too late
 					 */
-					printf("size-estimator: tx took too long, bailing !\n");
+					log_printf("size-estimator: tx took too long, bailing !\n");
 					break;
 				}
 			} while (1);
@@ -516,11 +556,13 @@ PROCESS_THREAD(proc_size_estimator, ev, data) {
 			radio_unlock();
 		}
 		PROCESS_WAIT_EVENT_UNTIL(ev == evt_end_of_epoch);
+		PROFILER_RECORD(PROF_END_OF_EPOCH_DELAY, (rtimer_clock_t)(RTIMER_NOW() - ((struct epoch_subscription *)data)->posted));
 		trace("@%d size-estimator recv packet ids %d-%d\n", __size_estimator.epoch, __min_packet_id, __max_packet_id);
 
 #ifdef TRACK_CONNECTIONS
 		connection_print_and_zero(CONNECTION_TRACK_DATA, __size_estimator.epoch);
 #endif
+		AIRTIME_PRINT_AND_ZERO(&__data_airtime, "data", __size_estimator.epoch);
 	} while (1);
 
 	PROCESS_END();
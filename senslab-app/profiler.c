@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "contiki.h"
+#include "util.h"
+#include "profiler.h"
+
+
+struct profiler_probe {
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t buckets[PROFILER_NR_BUCKETS];
+};
+
+
+static const char *_names[PROFILER_NR_PROBES] = {
+	"sync-recv",
+	"data-recv",
+	"queue-packet",
+	"suff-stats",
+	"sync-radio-lock",
+	"data-radio-lock",
+	"epoch-end-lateness",
+	"sync-send-slip",
+	"eoe-delay",
+	"glr-detector",
+	"size-estimates",
+};
+
+static struct profiler_probe _probes[PROFILER_NR_PROBES];
+static rtimer_clock_t _start[PROFILER_NR_PROBES];
+
+
+void profiler_start(uint8_t probe) {
+	assert(probe < PROFILER_NR_PROBES);
+
+	_start[probe] = RTIMER_NOW();
+}
+
+
+void profiler_stop(uint8_t probe) {
+	assert(probe < PROFILER_NR_PROBES);
+
+	profiler_record(probe, (rtimer_clock_t)(RTIMER_NOW() - _start[probe]));
+}
+
+
+void profiler_record(uint8_t probe, uint16_t ticks) {
+	struct profiler_probe *p;
+	uint8_t bucket;
+	uint16_t val;
+
+	assert(probe < PROFILER_NR_PROBES);
+
+	p = &_probes[probe];
+	if (!p->count || (ticks < p->min))
+		p->min = ticks;
+	if (!p->count || (ticks > p->max))
+		p->max = ticks;
+	p->sum += ticks;
+	if (p->count < 0xffff)
+		p->count++;
+
+	/*
+	 * the bucket is the number of bits of `ticks`
+	 */
+	bucket = 0;
+	for (val = ticks; val; val >>= 1)
+		bucket++;
+
+	if (p->buckets[bucket] < 0xffff)
+		p->buckets[bucket]++;
+}
+
+
+void profiler_print_and_zero(uint16_t epoch) {
+	uint8_t i, b;
+
+	for (i=0; i < PROFILER_NR_PROBES; i++) {
+		struct profiler_probe *p;
+
+		p = &_probes[i];
+		if (!p->count)
+			continue;
+
+		log_line_begin();
+		log_printf("@%d prof %s %u %u %lu %u", epoch, _names[i], p->count, p->min, (unsigned long int)(p->sum/p->count), p->max);
+		for (b=0; b < PROFILER_NR_BUCKETS; b++) {
+			if (p->buckets[b])
+				log_printf(" %d:%u", b, p->buckets[b]);
+		}
+		log_printf("\n");
+		log_line_end();
+
+		memset(p, 0, sizeof(struct profiler_probe));
+	}
+}
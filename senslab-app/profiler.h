@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include "contiki.h"
+#include "size-estimator-conf.h"
+
+
+/*
+ * Hot-path profiler
+ *
+ * When PROFILER is defined the code between PROFILER_START(probe) and
+ * PROFILER_STOP(probe) is timed with the rtimer clock. For each probe the
+ * profiler keeps, per epoch, the number of samples, their min/max/mean and a
+ * histogram with log2 buckets (bucket b counts the samples that need b bits,
+ * i.e. in [2^(b-1), 2^b) rtimer ticks). The epoch-syncer logs the statistics
+ * at each epoch end as
+ *
+ *   @epoch prof name count min mean max bucket:count ...
+ *
+ * When PROFILER is not defined the probes expand to nothing.
+ *
+ * ! the rtimer clock is 16bit wide: a probe can't measure more than 2s
+ *   (on the msp430 at 32768 ticks/s)
+ *
+ * ! probes can span kernel calls (e.g. PROCESS_PAUSE()) but can't be nested
+ *   with themselves
+ */
+
+/*
+ * Scheduling latency
+ *
+ * Three probes are recorded with PROFILER_RECORD() and measure by how much the
+ * kernel delays the epoch logic
+ *
+ * - epoch-end-lateness, the time between the end of epoch and the moment the
+ *   epoch-syncer wakes up to handle it
+ * - sync-send-slip, the time between the expiration of the sync send timer
+ *   and the moment the epoch-syncer wakes up to send the sync packet
+ * - eoe-delay, the time between the post of evt_end_of_epoch and the moment
+ *   the size-estimator consumes it
+ *
+ * ! a long callback or protothread run between two kernel calls shows up as a
+ *   tail in these distributions
+ *
+ * ! eoe-delay is recorded after the epoch-syncer has logged the statistics
+ *   of the ended epoch: it is logged one epoch later
+ */
+
+/*
+ * The probes
+ *
+ * ! start from 0, do not make holes in the numbering and update
+ *   PROFILER_NR_PROBES and the names in profiler.c if you change something
+ */
+#define PROF_SYNC_RECV           0
+#define PROF_DATA_RECV           1
+#define PROF_QUEUE_PACKET        2
+#define PROF_SUFF_STATS          3
+#define PROF_SYNC_RADIO_LOCK     4
+#define PROF_DATA_RADIO_LOCK     5
+#define PROF_EPOCH_END_LATENESS  6
+#define PROF_SYNC_SEND_SLIP      7
+#define PROF_END_OF_EPOCH_DELAY  8
+#define PROF_GLR_DETECTOR        9
+#define PROF_SIZE_ESTIMATES     10
+
+#define PROFILER_NR_PROBES       11
+
+#define PROFILER_NR_BUCKETS      17
+
+
+#ifdef PROFILER
+#define PROFILER_START(probe) profiler_start(probe)
+#define PROFILER_STOP(probe) profiler_stop(probe)
+#define PROFILER_RECORD(probe, ticks) profiler_record(probe, ticks)
+#define PROFILER_PRINT_AND_ZERO(epoch) profiler_print_and_zero(epoch)
+#else
+#define PROFILER_START(probe) {}
+#define PROFILER_STOP(probe) {}
+#define PROFILER_RECORD(probe, ticks) {}
+#define PROFILER_PRINT_AND_ZERO(epoch) {}
+#endif
+
+
+void profiler_start(uint8_t probe);
+void profiler_stop(uint8_t probe);
+void profiler_record(uint8_t probe, uint16_t ticks);
+void profiler_print_and_zero(uint16_t epoch);
+
+
+#endif /* __PROFILER_H__ */
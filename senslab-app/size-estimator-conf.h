@@ -66,6 +66,89 @@
 #define XFER_CRC16
 
 
+/*
+ * Define this macro to timestamp the sync packets with rtimer resolution
+ *
+ * When this macro is defined the epoch-syncer measures the epoch offsets in
+ * rtimer ticks (~30us) instead of kernel ticks (~8ms). See sync-time.h
+ */
+#define SYNC_FINE_TIMESTAMPS
+
+
+/*
+ * Define this macro to use the rx timestamps set by the radio driver
+ *
+ * When this macro is defined the epoch-syncer reads the sync packets
+ * arrival time from the PACKETBUF_ATTR_TIMESTAMP attribute instead of
+ * sampling the clock in the receive callback: this removes the rx queueing
+ * delay. The radio driver must set the attribute (in rtimer ticks) when the
+ * packet is received.
+ */
+//#define SYNC_MAC_TIMESTAMPS
+
+
+/*
+ * Define this macro to log the per-epoch statistics in binary form
+ *
+ * When this macro is defined the sufficient statistics and the connection
+ * tracks are written on the serial line as framed binary records instead
+ * of text: this is much cheaper for the node. See binlog.h
+ */
+//#define LOG_BINARY
+
+
+/*
+ * Define this macro to log the on-node size estimates
+ *
+ * The nodes always compute the size estimates M/-ln(stat) at the epoch start
+ * (see fractional48_size_estimate()). When this macro is defined they are
+ * also logged as `@epoch estim` next to the sufficient statistics.
+ */
+//#define LOG_SIZE_ESTIMATES
+
+
+/*
+ * Define this macro to run the GLR change detector on node
+ *
+ * When this macro is defined the uniform size estimator runs the change test
+ * of scripts/change_detection on its statistics at every epoch start and
+ * logs the results as `@epoch glr`. See glr-detector.h
+ */
+//#define GLR_DETECTOR
+
+
+/*
+ * Define this macro to defer the log output
+ *
+ * When this macro is defined the log output is written in a RAM ring buffer
+ * and a low priority process drains it to the serial line: writing to the
+ * uart doesn't delay the time-critical code anymore. See logbuf.h
+ */
+//#define LOG_DEFERRED
+
+
+/*
+ * Define this macro to profile the hot paths
+ *
+ * When this macro is defined the receive callbacks, the consensus packet
+ * preparation, the computation of the sufficient statistics and the radio
+ * lock waits are timed with the rtimer clock and per-epoch statistics are
+ * logged. See profiler.h
+ */
+//#define PROFILER
+
+
+/*
+ * Define this macro to account the airtime used by each channel
+ *
+ * When this macro is defined the sync and the consensus channels count the
+ * packets and bytes sent and received, the corrupted and discarded packets
+ * and the time spent transmitting. The counters are logged at each epoch
+ * end together with the energest times (if enabled). See net/airtime.h
+ */
+//#define AIRTIME_ACCOUNTING
+
+
 /* -------------------------------------------------------------------------- */
 
 
@@ -31,7 +31,12 @@
  */
 PROCESS(proc_epoch_syncer, "epoch-syncer");
 PROCESS(proc_size_estimator, "size-estimator");
+#ifdef LOG_DEFERRED
+PROCESS(proc_log_drainer, "log-drainer");
 
+AUTOSTART_PROCESSES(&proc_log_drainer, &proc_epoch_syncer, &proc_size_estimator);
+#else
 AUTOSTART_PROCESSES(&proc_epoch_syncer, &proc_size_estimator);
+#endif
 
 
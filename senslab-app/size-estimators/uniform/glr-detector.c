@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#include <stdint.h>
+#include <assert.h>
+#include "glr-detector.h"
+
+#if GLR_DETECTOR_M != 100 || GLR_DETECTOR_N != 25 || GLR_DETECTOR_BARN != 10
+#error the GLR thresholds have been calibrated for M = 100, N = 25 and barN = 10
+#endif
+
+/* X is clamped so that the sum over the window can't overflow */
+#define __GLR_X_MAX              (0xfffffffful/GLR_DETECTOR_WINDOW)
+
+
+/*
+ * log(lambda_T) for T = 1,...,N-barN+1, M = 100, N = 25, barN = 10, sigma = 1
+ * and alpha_0 = 0.001 (from scripts/change_detection/thresholds, see
+ * calibration.py)
+ */
+static const int32_t __log_lambdas[GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1] = {
+	-322843, -404986, -470064, -533522, -589201,
+	-646971, -707527, -764720, -827864, -893256,
+	-959277, -1028660, -1108030, -1194099, -1298616,
+	-1414496,
+};
+
+/* M*(1 - ln(M)) for M = 100, with ln(M) as returned by __ln() */
+#define __GLR_M_1_MINUS_LN_M     (-23626700l)
+
+
+/*
+ * Return ln(x) for x > 0 with GLR_DETECTOR_FRAC_BITS fractional bits
+ */
+static int32_t __ln(uint32_t x) {
+	fractional48_t f48;
+
+	assert(x != 0);
+
+	/* x/2^GLR_DETECTOR_FRAC_BITS = value*2^(exp-32) */
+	f48.value = x;
+	f48.exp = 32 - GLR_DETECTOR_FRAC_BITS;
+	while (!(f48.value & 0x80000000ul)) {
+		f48.value <<= 1;
+		f48.exp--;
+	}
+
+	return fractional48_ln(&f48);
+}
+
+
+/*
+ * Return the ring buffer position of the i-th oldest statistic
+ */
+__always_inline__ uint8_t __glr_pos(struct glr_detector *det, uint8_t i) {
+	uint8_t pos;
+
+	pos = det->head + i;
+	if (pos >= GLR_DETECTOR_WINDOW)
+		pos -= GLR_DETECTOR_WINDOW;
+
+	return pos;
+}
+
+
+/*
+ * Return the running sum in `sums` up to the statistic before the i-th
+ * oldest one
+ */
+__always_inline__ uint32_t __glr_sum_before(struct glr_detector *det, const uint32_t *sums, uint32_t base, uint8_t i) {
+	return i ? sums[__glr_pos(det, i - 1)] : base;
+}
+
+
+__always_inline__ uint32_t __saturate_u32(uint64_t val) {
+	if (val > 0xfffffffful)
+		return 0xfffffffful;
+
+	return (uint32_t)val;
+}
+
+
+void glr_detector_init(struct glr_detector *det) {
+	assert(det != NULL);
+
+	det->base_sum_x = 0;
+	det->base_sum_m_ln_x = 0;
+	det->head = 0;
+	det->count = 0;
+}
+
+
+char glr_detector_push(struct glr_detector *det, const fractional48_t *stat, struct glr_detector_result *res) {
+	int64_t min_log_lambda;
+	uint32_t argmin_bar_s;
+	uint8_t argmin_T;
+	uint32_t x, s_max, sum_x, sum_m_ln_x;
+	uint32_t max_s[GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1];
+	uint8_t pos, newest, idx, T;
+
+	assert(det != NULL);
+	assert(stat != NULL);
+	assert(res != NULL);
+
+	/*
+	 * X = -ln(stat), clamped to [2^-GLR_DETECTOR_FRAC_BITS, __GLR_X_MAX]
+	 */
+	if (stat->value == 0) {
+		x = __GLR_X_MAX;
+	} else {
+		int32_t ln_stat;
+
+		ln_stat = fractional48_ln(stat);
+		assert(ln_stat <= 0);
+		x = (uint32_t)(-ln_stat);
+		if (x > __GLR_X_MAX)
+			x = __GLR_X_MAX;
+		else if (x == 0)
+			x = 1;
+	}
+
+	/*
+	 * Push X(t), dropping X(t-N-1)
+	 */
+	sum_x = __glr_sum_before(det, det->sum_x, det->base_sum_x, det->count);
+	sum_m_ln_x = __glr_sum_before(det, det->sum_m_ln_x, det->base_sum_m_ln_x, det->count);
+	if (det->count < GLR_DETECTOR_WINDOW) {
+		pos = __glr_pos(det, det->count);
+		det->count++;
+	} else {
+		pos = det->head;
+		det->base_sum_x = det->sum_x[pos];
+		det->base_sum_m_ln_x = det->sum_m_ln_x[pos];
+		det->head = __glr_pos(det, 1);
+	}
+	det->sum_x[pos] = sum_x + x;
+	det->sum_m_ln_x[pos] = sum_m_ln_x + (uint32_t)(GLR_DETECTOR_M*__ln(x));
+	det->s[pos] = __saturate_u32(((uint64_t)GLR_DETECTOR_M << (2*GLR_DETECTOR_FRAC_BITS))/x);
+
+	if (det->count < GLR_DETECTOR_WINDOW)
+		return -1;
+
+	/*
+	 * max_s[T-1] = max(S(t-T+1),...,S(t))
+	 */
+	s_max = 0;
+	for (T=1; T <= GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1; T++) {
+		pos = __glr_pos(det, GLR_DETECTOR_N + 1 - T);
+		if (det->s[pos] > s_max)
+			s_max = det->s[pos];
+		max_s[T - 1] = s_max;
+	}
+
+	/*
+	 * Find the optimal change time
+	 *
+	 * ! the sums over the pre- and post-change windows are differences of
+	 *   the running sums: no loop over the window is needed unless some
+	 *   post-change epoch has to be left out of the log-GLR
+	 */
+	min_log_lambda = 0;
+	argmin_T = 1;
+	argmin_bar_s = 0;
+	newest = __glr_pos(det, GLR_DETECTOR_N);
+
+	for (T=GLR_DETECTOR_N - GLR_DETECTOR_BARN + 1; T >= 1; T--) {
+		uint32_t bar_s, sigma_bar_s, post_sum_x;
+		int32_t post_sum_m_ln_x;
+		uint8_t nr_post;
+		int64_t c, log_lambda;
+
+		/* the last pre-change epoch X(t-T) */
+		pos = __glr_pos(det, GLR_DETECTOR_N - T);
+
+		bar_s = __saturate_u32((((uint64_t)GLR_DETECTOR_M*(GLR_DETECTOR_N + 1 - T)) << (2*GLR_DETECTOR_FRAC_BITS))/(det->sum_x[pos] - det->base_sum_x));
+		sigma_bar_s = __saturate_u32(((uint64_t)bar_s*GLR_DETECTOR_SIGMA) >> GLR_DETECTOR_FRAC_BITS);
+		if (!sigma_bar_s)
+			sigma_bar_s = 1;
+
+		c = (int64_t)GLR_DETECTOR_M*__ln(sigma_bar_s) + __GLR_M_1_MINUS_LN_M;
+
+		/*
+		 * compute the log-GLR using X(t-T+1),...,X(t): only the epochs whose
+		 * size estimate S = M/X is below sigma*barS contribute
+		 *
+		 * ! S is rounded down: S < sigma*barS if and only if M/X < sigma*barS
+		 */
+		if (max_s[T - 1] < sigma_bar_s) {
+			nr_post = T;
+			post_sum_x = det->sum_x[newest] - det->sum_x[pos];
+			post_sum_m_ln_x = (int32_t)(det->sum_m_ln_x[newest] - det->sum_m_ln_x[pos]);
+		} else {
+			nr_post = 0;
+			post_sum_x = 0;
+			post_sum_m_ln_x = 0;
+			sum_x = det->sum_x[pos];
+			sum_m_ln_x = det->sum_m_ln_x[pos];
+			for (idx=GLR_DETECTOR_N - T + 1; idx <= GLR_DETECTOR_N; idx++) {
+				pos = __glr_pos(det, idx);
+				if (det->s[pos] < sigma_bar_s) {
+					nr_post++;
+					post_sum_x += det->sum_x[pos] - sum_x;
+					post_sum_m_ln_x += (int32_t)(det->sum_m_ln_x[pos] - sum_m_ln_x);
+				}
+				sum_x = det->sum_x[pos];
+				sum_m_ln_x = det->sum_m_ln_x[pos];
+			}
+		}
+
+		log_lambda = nr_post*c - (int64_t)(((uint64_t)sigma_bar_s*post_sum_x) >> GLR_DETECTOR_FRAC_BITS) + post_sum_m_ln_x;
+
+		if (log_lambda <= min_log_lambda) {
+			min_log_lambda = log_lambda;
+			argmin_T = T;
+			argmin_bar_s = bar_s;
+		}
+	}
+
+	res->change_time = argmin_T;
+	res->pre_change_size = argmin_bar_s;
+	res->log_lambda = (min_log_lambda < INT32_MIN) ? INT32_MIN : (int32_t)min_log_lambda;
+	res->alarm = (min_log_lambda < __log_lambdas[argmin_T - 1]);
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __GLR_DETECTOR_H__
+#define __GLR_DETECTOR_H__
+
+#include <stdint.h>
+#include "fractional48.h"
+
+
+/*
+ * GLR change detector
+ *
+ * This is the on-node version of the test run by Node.tick_epoch() in
+ * scripts/change_detection/node.py. There is one detector for each k-steps
+ * neighborhood: it keeps the statistics X(t-N),...,X(t), with
+ * X = -ln(\prod_{m=1}^{M} f_k,m), of the last GLR_DETECTOR_N+1 epochs in a
+ * ring buffer. At each epoch start it looks for the change time T in
+ * [1, N-barN+1] that minimizes the log-GLR of a drop of the network size
+ * below sigma times the size estimated on X(t-N),...,X(t-T). An alarm is
+ * raised when the minimum is below the threshold log(lambda_T).
+ *
+ * All quantities are in natural log units, fixed-point with
+ * GLR_DETECTOR_FRAC_BITS fractional bits.
+ *
+ * ! the thresholds log(lambda_T) have been calibrated offline for these
+ *   M, N, barN, sigma and alpha_0 = 0.001 (see calibration.py)
+ *
+ * ! each detector takes (N+1)*12+8 bytes of RAM. The window keeps the
+ *   running sums of X and M*ln(X) and the size estimates S = M/X: the sums
+ *   over the pre- and post-change windows of each T are differences of two
+ *   running sums. One test takes N-barN+1 divisions and logarithms and
+ *   4(N-barN+1) 64bit multiplications, plus one division for the pushed
+ *   statistic. The post-change epochs are scanned (with 32bit compares and
+ *   additions) only for the T whose window has epochs left out of the
+ *   log-GLR
+ */
+#define GLR_DETECTOR_M           100
+#define GLR_DETECTOR_N           25
+#define GLR_DETECTOR_BARN        10
+#define GLR_DETECTOR_FRAC_BITS   FRACTIONAL48_LOG2_FRAC_BITS
+
+//! sigma, with GLR_DETECTOR_FRAC_BITS fractional bits
+#define GLR_DETECTOR_SIGMA       ((uint32_t)1 << GLR_DETECTOR_FRAC_BITS)
+
+#define GLR_DETECTOR_WINDOW      (GLR_DETECTOR_N + 1)
+
+
+struct glr_detector {
+	//! the running sums of X up to X(t-N),...,X(t), modulo 2^32: the oldest
+	//! one is at .head
+	uint32_t sum_x[GLR_DETECTOR_WINDOW];
+
+	//! the running sums of M*ln(X) of the same epochs, modulo 2^32
+	uint32_t sum_m_ln_x[GLR_DETECTOR_WINDOW];
+
+	//! S = M/X of the same epochs, saturated to 2^32-1
+	uint32_t s[GLR_DETECTOR_WINDOW];
+
+	//! the running sums up to X(t-N-1)
+	uint32_t base_sum_x;
+	uint32_t base_sum_m_ln_x;
+
+	uint8_t head;
+	uint8_t count;
+};
+
+
+struct glr_detector_result {
+	//! The optimal change time T
+	uint8_t change_time;
+
+	//! The pre-change size estimate (barS)
+	uint32_t pre_change_size;
+
+	//! The minimum log-GLR
+	int32_t log_lambda;
+
+	char alarm;
+};
+
+
+void glr_detector_init(struct glr_detector *det);
+
+/*
+ * Push the sufficient statistic of the last epoch and run the test
+ *
+ * Return 0 if the test has been run and `res` is valid, -1 if there are
+ * not yet N+1 statistics in the window.
+ */
+char glr_detector_push(struct glr_detector *det, const fractional48_t *stat, struct glr_detector_result *res);
+
+
+#if GLR_DETECTOR_BARN < 1 || GLR_DETECTOR_BARN >= GLR_DETECTOR_N
+#error choose GLR_DETECTOR_BARN in [1, GLR_DETECTOR_N)
+#endif
+
+#if GLR_DETECTOR_WINDOW > 255
+#error choose a smaller GLR_DETECTOR_N
+#endif
+
+#endif /* __GLR_DETECTOR_H__ */
@@ -26,6 +26,10 @@
 #include "math/distributions.h"
 #include "matrix.h"
 #include "uni-size-estimator.h"
+#include "profiler.h"
+#ifdef LOG_BINARY
+#include "binlog.h"
+#endif
 
 #define __UNIFORM_SIZE_ESTIMATOR_NR_DATA_CELLS (UNIFORM_SIZE_ESTIMATOR_M*UNIFORM_SIZE_ESTIMATOR_D)
 
@@ -63,6 +67,69 @@ static void __compute_sufficient_statistics(struct uniform_size_estimator *estim
 }
 
 
+/*
+ * Compute the size estimates M/-ln(\prod_{m=1}^{M} f_k,m(t)) for k = 1,...,D
+ */
+static void __compute_size_estimates(struct uniform_size_estimator *estim) {
+	uint16_t col;
+
+	assert(estim != NULL);
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++)
+		estim->size_estimates[col] = fractional48_size_estimate(&estim->sufficient_stats[col], UNIFORM_SIZE_ESTIMATOR_M);
+}
+
+
+#ifdef GLR_DETECTOR
+static void __reset_detectors(struct uniform_size_estimator *estim) {
+	uint16_t col;
+
+	assert(estim != NULL);
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++)
+		glr_detector_init(&estim->detectors[col]);
+
+	estim->alarms = 0;
+}
+
+
+/*
+ * Run the change detectors on the new sufficient statistics and log the tests
+ */
+static void __run_detectors(struct uniform_size_estimator *estim) {
+	uint16_t col;
+	char tested;
+
+	assert(estim != NULL);
+
+	PROFILER_START(PROF_GLR_DETECTOR);
+	estim->alarms = 0;
+	tested = 0;
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++) {
+		struct glr_detector_result res;
+
+		if (glr_detector_push(&estim->detectors[col], &estim->sufficient_stats[col], &res))
+			continue;
+
+		if (!tested) {
+			log_line_begin();
+			log_printf("@%d glr", estim->epoch);
+			tested = 1;
+		}
+
+		/* T:barS:log-GLR*100:alarm */
+		log_printf(" %d:%lu:%ld:%d", res.change_time, (unsigned long int)(res.pre_change_size >> GLR_DETECTOR_FRAC_BITS),
+			   (long int)(((int64_t)res.log_lambda*100) >> GLR_DETECTOR_FRAC_BITS), res.alarm);
+		if (res.alarm)
+			estim->alarms |= 1 << col;
+	}
+	if (tested) {
+		log_printf("\n");
+		log_line_end();
+	}
+	PROFILER_STOP(PROF_GLR_DETECTOR);
+}
+#endif
+
+
 static void _enable(struct uniform_size_estimator *estim) {
 	uint16_t col;
 	assert(estim != NULL);
@@ -82,6 +149,9 @@ static void _enable(struct uniform_size_estimator *estim) {
 
 	matrix_rawcopy_to_array(&estim->consensus_mat, __epoch_start_data_storage);
 
+#ifdef GLR_DETECTOR
+	__reset_detectors(estim);
+#endif
 	estim->enabled = 1;
 }
 
@@ -119,6 +189,11 @@ void uni_size_estimator_jump_to_epoch(struct uniform_size_estimator *estim, uint
 	printf("size-estimator: jumping epoch %d -> %d\n", estim->epoch, new_epoch);
 
 	estim->epoch = new_epoch;
+
+#ifdef GLR_DETECTOR
+	/* the statistics of the skipped epochs are missing, restart the tests */
+	__reset_detectors(estim);
+#endif
 }
 
 
@@ -134,20 +209,61 @@ void uni_size_estimator_at_epoch_start(struct uniform_size_estimator *estim) {
 		return;
 	}
 
+	PROFILER_START(PROF_SUFF_STATS);
 	__compute_sufficient_statistics(estim);
+	PROFILER_STOP(PROF_SUFF_STATS);
+
+	PROFILER_START(PROF_SIZE_ESTIMATES);
+	__compute_size_estimates(estim);
+	PROFILER_STOP(PROF_SIZE_ESTIMATES);
 
 	/*
 	 * Log the sufficient statistics to the serial line
 	 */
-	printf("@%d stats", estim->epoch);
+#ifdef LOG_BINARY
+	binlog_begin(BINLOG_REC_STATS, estim->epoch);
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++) {
+		binlog_put_u32(estim->sufficient_stats[col].value);
+		binlog_put_u16(estim->sufficient_stats[col].exp);
+	}
+	binlog_end();
+#else
+	log_line_begin();
+	log_printf("@%d stats", estim->epoch);
 	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++) {
 		fractional48_t *stat;
 
 		stat = &estim->sufficient_stats[col];
-		printf(" %.8lx.%d", (unsigned long int)stat->value, stat->exp);
+		log_printf(" %.8lx.%d", (unsigned long int)stat->value, stat->exp);
 	}
-	printf("\n");
+	log_printf("\n");
+	log_line_end();
+#endif
+
+#ifdef LOG_SIZE_ESTIMATES
+#ifdef LOG_BINARY
+	binlog_begin(BINLOG_REC_ESTIMATES, estim->epoch);
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++)
+		binlog_put_u32(estim->size_estimates[col]);
+	binlog_end();
+#else
+	log_line_begin();
+	log_printf("@%d estim", estim->epoch);
+	for (col=0; col<UNIFORM_SIZE_ESTIMATOR_D; col++) {
+		uint32_t e;
 
+		e = estim->size_estimates[col];
+		log_printf(" %lu.%.2u", (unsigned long int)(e >> FRACTIONAL48_ESTIMATE_FRAC_BITS),
+			   (unsigned int)(((e & ((1 << FRACTIONAL48_ESTIMATE_FRAC_BITS) - 1))*100) >> FRACTIONAL48_ESTIMATE_FRAC_BITS));
+	}
+	log_printf("\n");
+	log_line_end();
+#endif
+#endif
+
+#ifdef GLR_DETECTOR
+	__run_detectors(estim);
+#endif
 
 	estim->epoch++;
 
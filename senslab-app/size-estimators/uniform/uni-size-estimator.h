@@ -33,6 +33,9 @@
 #include "fractional48.h"
 #include "matrix.h"
 #include "packet-splitter.h"
+#ifdef GLR_DETECTOR
+#include "glr-detector.h"
+#endif
 
 
 /*
@@ -50,6 +53,17 @@ struct uniform_size_estimator {
 	uint16_t epoch;
 	struct matrix consensus_mat;
 	fractional48_t sufficient_stats[UNIFORM_SIZE_ESTIMATOR_D];
+
+	/* The size estimates M/-ln(stat), see fractional48_size_estimate() */
+	uint32_t size_estimates[UNIFORM_SIZE_ESTIMATOR_D];
+
+#ifdef GLR_DETECTOR
+	/* One change detector for each k, see glr-detector.h */
+	struct glr_detector detectors[UNIFORM_SIZE_ESTIMATOR_D];
+
+	/* Bit k-1 is set if the detector for k raised an alarm at the last epoch start */
+	uint16_t alarms;
+#endif
 	
 	/* The embedded packet-splitter object */
 	struct packet_splitter splitter;
@@ -92,5 +106,33 @@ __always_inline__ char uni_size_estimator_enabled(struct uniform_size_estimator
 	return estim->enabled;
 }
 
+
+/*
+ * Return the size estimate for the k-steps neighborhood (k = 1,...,D) computed
+ * at the last epoch start, with FRACTIONAL48_ESTIMATE_FRAC_BITS fractional bits
+ */
+__always_inline__ uint32_t uni_size_estimator_get_estimate(struct uniform_size_estimator *estim, uint16_t k) {
+	assert(estim != NULL);
+	assert(k >= 1 && k <= UNIFORM_SIZE_ESTIMATOR_D);
+	return estim->size_estimates[k - 1];
+}
+
+
+#ifdef GLR_DETECTOR
+__always_inline__ uint16_t uni_size_estimator_get_alarms(struct uniform_size_estimator *estim) {
+	assert(estim != NULL);
+	return estim->alarms;
+}
+#endif
+
+
+#if defined(GLR_DETECTOR) && (UNIFORM_SIZE_ESTIMATOR_M != GLR_DETECTOR_M)
+#error the GLR detector thresholds do not match UNIFORM_SIZE_ESTIMATOR_M
+#endif
+
+#if defined(GLR_DETECTOR) && (UNIFORM_SIZE_ESTIMATOR_D > 16)
+#error the GLR alarms mask is too small for UNIFORM_SIZE_ESTIMATOR_D
+#endif
+
 #endif /* __UNIFORM_SIZE_ESTIMATOR_H__ */
 
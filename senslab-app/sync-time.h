@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012 Riccardo Lucchese, lucchese at dei.unipd.it
+ *               2012 Damiano Varagnolo, varagnolo at dei.unipd.it
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef __SYNC_TIME_H__
+#define __SYNC_TIME_H__
+
+#include <stdint.h>
+#include "contiki.h"
+#include "util.h"
+#include "size-estimator-conf.h"
+
+#ifdef SYNC_MAC_TIMESTAMPS
+#include "net/packetbuf.h"
+#endif
+
+
+/*
+ * Sync time
+ *
+ * The epoch-syncer timestamps the sync packets with the `sync time`: the
+ * kernel clock extended with the sub-tick count of the hardware timer that
+ * drives both the kernel clock and the rtimers (on the msp430 one kernel tick
+ * is RTIMER_ARCH_SECOND/CLOCK_SECOND = 256 rtimer ticks of ~30us each).
+ *
+ * When SYNC_FINE_TIMESTAMPS is not defined the sync time is the plain kernel
+ * clock.
+ *
+ * ! the sync time is kept in a 32bit counter and wraps around after ~36 hours
+ *   of uptime at 32768 ticks/s: always compare sync times trough differences
+ */
+typedef uint32_t sync_time_t;
+
+#ifdef SYNC_FINE_TIMESTAMPS
+#define SYNC_TIME_FINE_PER_TICK  (RTIMER_ARCH_SECOND/CLOCK_SECOND)
+#else
+#define SYNC_TIME_FINE_PER_TICK  (1)
+#endif
+
+//! Convert kernel ticks to sync time
+#define SYNC_TIME_FROM_CLOCK(t)  ((sync_time_t)(t)*SYNC_TIME_FINE_PER_TICK)
+
+
+/*!
+ * Return the current sync time.
+ */
+__always_inline__ sync_time_t sync_time_now(void) {
+#ifdef SYNC_FINE_TIMESTAMPS
+	clock_time_t ticks;
+	unsigned short fine;
+
+	/*
+	 * ! the kernel clock is updated in the timer interrupt: read it again
+	 *   to be sure that the two readings refer to the same tick
+	 */
+	do {
+		ticks = clock_time();
+		fine = clock_fine();
+	} while (ticks != clock_time());
+
+	/*
+	 * ! the fine count can exceed the tick length if the timer interrupt is
+	 *   pending
+	 */
+	if (fine >= SYNC_TIME_FINE_PER_TICK)
+		fine = SYNC_TIME_FINE_PER_TICK - 1;
+
+	return SYNC_TIME_FROM_CLOCK(ticks) + fine;
+#else
+	return clock_time();
+#endif
+}
+
+
+#ifdef SYNC_MAC_TIMESTAMPS
+/*!
+ * Return the sync time at which the packet currently in the packetbuf was
+ * received, as stamped by the radio driver in PACKETBUF_ATTR_TIMESTAMP
+ * (the rtimer clock, 16bit).
+ *
+ * ! this removes the rx queueing delay from the measured offsets but
+ *   requires a radio driver setting the timestamp attribute
+ */
+__always_inline__ sync_time_t sync_time_packet_rx(void) {
+	rtimer_clock_t age;
+
+	/*
+	 * ! with SYNC_FINE_TIMESTAMPS one sync time unit is one rtimer tick
+	 */
+	age = RTIMER_NOW() - (rtimer_clock_t)packetbuf_attr(PACKETBUF_ATTR_TIMESTAMP);
+	return sync_time_now() - age;
+}
+#endif
+
+
+/*!
+ * Convert a (signed) sync time interval to kernel ticks, rounding to the
+ * nearest tick.
+ */
+__always_inline__ long int sync_time_to_clock(long int interval) {
+	if (interval >= 0)
+		return (interval + SYNC_TIME_FINE_PER_TICK/2)/SYNC_TIME_FINE_PER_TICK;
+
+	return (interval - SYNC_TIME_FINE_PER_TICK/2)/SYNC_TIME_FINE_PER_TICK;
+}
+
+
+/*!
+ * Convert a (signed) sync time interval to kernel ticks with `frac_bits`
+ * fractional bits.
+ */
+__always_inline__ long int sync_time_to_fixpoint(long int interval, uint8_t frac_bits) {
+	return (long int)(((int64_t)interval << frac_bits)/SYNC_TIME_FINE_PER_TICK);
+}
+
+
+/*!
+ * Convert a sync time interval to rtimer ticks, saturating to [0, 0xffff]
+ * (the range of the 16bit rtimer clock).
+ */
+__always_inline__ uint16_t sync_time_to_rtimer(long int interval) {
+	int64_t ticks;
+
+	if (interval <= 0)
+		return 0;
+
+	ticks = (int64_t)interval*(RTIMER_ARCH_SECOND/CLOCK_SECOND)/SYNC_TIME_FINE_PER_TICK;
+	if (ticks > 0xffff)
+		return 0xffff;
+
+	return (uint16_t)ticks;
+}
+
+
+#if defined(SYNC_MAC_TIMESTAMPS) && !defined(SYNC_FINE_TIMESTAMPS)
+#error SYNC_MAC_TIMESTAMPS requires SYNC_FINE_TIMESTAMPS
+#endif
+
+#if SYNC_TIME_FINE_PER_TICK < 1 || SYNC_TIME_FINE_PER_TICK > 256
+#error the rtimer must run at 1 to 256 times the kernel clock rate
+#endif
+
+#endif /* __SYNC_TIME_H__ */
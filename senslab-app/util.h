@@ -28,6 +28,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "ds2411.h"
+#include "size-estimator-conf.h"
+#ifdef LOG_DEFERRED
+#include "logbuf.h"
+#endif
 
 
 /*
@@ -66,15 +70,33 @@ void printhex(const char *mem, uint16_t len);
 void printhex2(const char *mem, uint16_t len);
 
 
+/*
+ * Log to the serial line
+ *
+ * log_printf() is printf() or, when LOG_DEFERRED is defined, writes to the
+ * logbuf ring buffer (see logbuf.h). Wrap the calls writing a single line in
+ * log_line_begin() and log_line_end().
+ */
+#ifdef LOG_DEFERRED
+#define log_printf(...) logbuf_printf(__VA_ARGS__)
+#define log_line_begin() logbuf_line_begin()
+#define log_line_end() logbuf_line_end()
+#else
+#define log_printf(...) printf(__VA_ARGS__)
+#define log_line_begin() do {} while (0)
+#define log_line_end() do {} while (0)
+#endif
+
+
 /*
  * Define this macro to enable tracing
  *
  * ! Enabling tracing can be very verbose and interfere with the test 
- * (eg. by introducing delays).
+ * (eg. by introducing delays). Define LOG_DEFERRED to mitigate this.
  */
 #define DBG_TRACE
 #ifdef DBG_TRACE
-#define trace(...) printf(__VA_ARGS__)
+#define trace(...) log_printf(__VA_ARGS__)
 #else
 #define trace(...) {}
 #endif
@@ -89,7 +111,7 @@ void printhex2(const char *mem, uint16_t len);
 #ifdef NDEBUG
 #define dbg(...) {}
 #else
-#define dbg(...) printf(__VA_ARGS__)
+#define dbg(...) log_printf(__VA_ARGS__)
 #endif
 
 